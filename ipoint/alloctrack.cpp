@@ -0,0 +1,255 @@
+#include "alloctrack.h"
+
+#ifdef USE_ALLOC_TRACKING
+
+#include <new>
+#include <cstdlib>
+#include <stdint.h>
+
+#ifdef _MSC_VER
+  #define ALLOC_TLS __declspec(thread)
+#else
+  #define ALLOC_TLS __thread
+#endif
+
+namespace
+{
+  // plain data, usable before any constructor has run
+  ALLOC_TLS long long allocsN_, freesN_, bytes_, current_, peak_;
+
+  // keeps size of block, preserves alignment of malloc
+  const size_t headerSize = 16;
+
+  void * trackedAlloc(size_t size)
+  {
+    char * p = (char*)malloc(size + headerSize);
+    if ( !p )
+      return 0;
+
+    *(size_t*)p = size;
+
+    allocsN_++;
+    bytes_ += size;
+    current_ += size;
+    if ( current_ > peak_ )
+      peak_ = current_;
+
+    return p + headerSize;
+  }
+
+  void trackedFree(void * ptr)
+  {
+    if ( !ptr )
+      return;
+
+    // block could be allocated by another thread, so current_ may go below zero
+    char * p = (char*)ptr - headerSize;
+    freesN_++;
+    current_ -= *(size_t*)p;
+    free(p);
+  }
+
+#ifdef __cpp_aligned_new
+  // header right before the block keeps its size and the pointer from malloc
+  void * trackedAlignedAlloc(size_t size, size_t alignment)
+  {
+    if ( alignment < headerSize )
+      alignment = headerSize;
+
+    char * raw = (char*)malloc(size + alignment + headerSize);
+    if ( !raw )
+      return 0;
+
+    char * p = (char*)(((uintptr_t)raw + headerSize + alignment - 1) & ~(uintptr_t)(alignment - 1));
+    ((size_t*)p)[-2] = size;
+    ((char**)p)[-1] = raw;
+
+    allocsN_++;
+    bytes_ += size;
+    current_ += size;
+    if ( current_ > peak_ )
+      peak_ = current_;
+
+    return p;
+  }
+
+  void trackedAlignedFree(void * ptr)
+  {
+    if ( !ptr )
+      return;
+
+    freesN_++;
+    current_ -= ((size_t*)ptr)[-2];
+    free(((char**)ptr)[-1]);
+  }
+#endif
+}
+
+void * operator new(size_t size)
+{
+  void * p = trackedAlloc(size ? size : 1);
+  if ( !p )
+    throw std::bad_alloc();
+  return p;
+}
+
+void * operator new[](size_t size)
+{
+  void * p = trackedAlloc(size ? size : 1);
+  if ( !p )
+    throw std::bad_alloc();
+  return p;
+}
+
+void * operator new(size_t size, const std::nothrow_t & ) throw()
+{
+  return trackedAlloc(size ? size : 1);
+}
+
+void * operator new[](size_t size, const std::nothrow_t & ) throw()
+{
+  return trackedAlloc(size ? size : 1);
+}
+
+void operator delete(void * p) throw()
+{
+  trackedFree(p);
+}
+
+void operator delete[](void * p) throw()
+{
+  trackedFree(p);
+}
+
+void operator delete(void * p, const std::nothrow_t & ) throw()
+{
+  trackedFree(p);
+}
+
+void operator delete[](void * p, const std::nothrow_t & ) throw()
+{
+  trackedFree(p);
+}
+
+#ifdef __cpp_sized_deallocation
+void operator delete(void * p, size_t ) throw()
+{
+  trackedFree(p);
+}
+
+void operator delete[](void * p, size_t ) throw()
+{
+  trackedFree(p);
+}
+#endif
+
+#ifdef __cpp_aligned_new
+void * operator new(size_t size, std::align_val_t alignment)
+{
+  void * p = trackedAlignedAlloc(size ? size : 1, (size_t)alignment);
+  if ( !p )
+    throw std::bad_alloc();
+  return p;
+}
+
+void * operator new[](size_t size, std::align_val_t alignment)
+{
+  void * p = trackedAlignedAlloc(size ? size : 1, (size_t)alignment);
+  if ( !p )
+    throw std::bad_alloc();
+  return p;
+}
+
+void * operator new(size_t size, std::align_val_t alignment, const std::nothrow_t & ) throw()
+{
+  return trackedAlignedAlloc(size ? size : 1, (size_t)alignment);
+}
+
+void * operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t & ) throw()
+{
+  return trackedAlignedAlloc(size ? size : 1, (size_t)alignment);
+}
+
+void operator delete(void * p, std::align_val_t ) throw()
+{
+  trackedAlignedFree(p);
+}
+
+void operator delete[](void * p, std::align_val_t ) throw()
+{
+  trackedAlignedFree(p);
+}
+
+void operator delete(void * p, size_t , std::align_val_t ) throw()
+{
+  trackedAlignedFree(p);
+}
+
+void operator delete[](void * p, size_t , std::align_val_t ) throw()
+{
+  trackedAlignedFree(p);
+}
+
+void operator delete(void * p, std::align_val_t , const std::nothrow_t & ) throw()
+{
+  trackedAlignedFree(p);
+}
+
+void operator delete[](void * p, std::align_val_t , const std::nothrow_t & ) throw()
+{
+  trackedAlignedFree(p);
+}
+#endif
+
+bool iAlloc::tracking()
+{
+  return true;
+}
+
+AllocSample iAlloc::threadSample()
+{
+  AllocSample sample;
+  sample.allocs_ = allocsN_;
+  sample.frees_ = freesN_;
+  sample.bytes_ = bytes_;
+  sample.current_ = current_;
+  sample.peak_ = peak_;
+  return sample;
+}
+
+void iAlloc::resetThreadPeak()
+{
+  peak_ = current_;
+}
+
+void iAlloc::addToThread(const AllocSample & other)
+{
+  allocsN_ += other.allocs_;
+  freesN_ += other.frees_;
+  bytes_ += other.bytes_;
+  if ( current_ + other.peak_ > peak_ )
+    peak_ = current_ + other.peak_;
+  current_ += other.current_;
+}
+
+#else
+
+bool iAlloc::tracking()
+{
+  return false;
+}
+
+AllocSample iAlloc::threadSample()
+{
+  return AllocSample();
+}
+
+void iAlloc::resetThreadPeak()
+{
+}
+
+void iAlloc::addToThread(const AllocSample & )
+{
+}
+
+#endif
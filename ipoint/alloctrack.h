@@ -0,0 +1,45 @@
+#pragma once
+
+#include "icommon.h"
+
+// heap allocations of the current thread, counted when built with USE_ALLOC_TRACKING
+struct AllocSample
+{
+  AllocSample() : allocs_(0), frees_(0), bytes_(0), current_(0), peak_(0) {}
+
+  // number of allocations and frees
+  long long allocs_, frees_;
+
+  // total bytes allocated
+  long long bytes_;
+
+  // bytes allocated and not freed yet, its maximum
+  long long current_, peak_;
+
+  // differences of counters. current_ and peak_ are taken from this
+  AllocSample operator - (const AllocSample & other) const
+  {
+    AllocSample r(*this);
+    r.allocs_ -= other.allocs_;
+    r.frees_ -= other.frees_;
+    r.bytes_ -= other.bytes_;
+    return r;
+  }
+};
+
+namespace iAlloc
+{
+
+// false if allocations aren't tracked
+bool tracking();
+
+AllocSample threadSample();
+
+// start looking for a new peak from the current footprint
+void resetThreadPeak();
+
+// adds allocations made for this thread by others, e.g. tasks of its TaskPool.
+// peak_ of other is its maximum over current_ at the time it was taken
+void addToThread(const AllocSample & other);
+
+}
@@ -0,0 +1,41 @@
+# triangulation core shared by the application and the console tools
+
+DEPENDPATH += $$PWD
+INCLUDEPATH += $$PWD
+
+HEADERS += $$PWD/alloctrack.h \
+           $$PWD/delaunay.h \
+           $$PWD/engine.h \
+           $$PWD/icommon.h \
+           $$PWD/imath.h \
+           $$PWD/iprofile.h \
+           $$PWD/meshcheck.h \
+           $$PWD/meshio.h \
+           $$PWD/meshopt.h \
+           $$PWD/octree.h \
+           $$PWD/oredge.h \
+           $$PWD/perfcounters.h \
+           $$PWD/planar.h \
+           $$PWD/pipeline.h \
+           $$PWD/rect.h \
+           $$PWD/sparse.h \
+           $$PWD/taskpool.h \
+           $$PWD/tristats.h \
+           $$PWD/vec.h
+SOURCES += $$PWD/alloctrack.cpp \
+           $$PWD/delaunay.cpp \
+           $$PWD/engine.cpp \
+           $$PWD/imath.cpp \
+           $$PWD/iprofile.cpp \
+           $$PWD/meshcheck.cpp \
+           $$PWD/meshio.cpp \
+           $$PWD/meshopt.cpp \
+           $$PWD/oredge.cpp \
+           $$PWD/perfcounters.cpp \
+           $$PWD/planar.cpp \
+           $$PWD/pipeline.cpp \
+           $$PWD/sparse.cpp \
+           $$PWD/taskpool.cpp \
+           $$PWD/tristats.cpp
+
+unix:LIBS += -lboost_thread -lboost_chrono -lboost_system
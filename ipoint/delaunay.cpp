@@ -1,20 +1,34 @@
 #include "delaunay.h"
 #include "imath.h"
+#include "meshcheck.h"
+#include "meshopt.h"
+#include "iprofile.h"
+#include "sparse.h"
+#include <boost/bind/bind.hpp>
 #include <time.h>
 #include <algorithm>
 #include <fstream>
 #include <limits>
+#include <map>
 
 using namespace iMath;
 
-DelaunayTriangulator::DelaunayTriangulator(Vertices & verts) :
+namespace
+{
+  const int indexDepth = 5;
+}
+
+DelaunayTriangulator::DelaunayTriangulator(Vertices & verts, const TriangulationOptions & options) :
+  options_(options),
   container_(verts),
   edgeLength_(0), rotateThreshold_(0), splitThreshold_(0), thinThreshold_(0),
-  convexThreshold_(0.07), dimensionThreshold_(0)
+  convexThreshold_(0.07), dimensionThreshold_(0), planar_(false), projected_(false)
 {
   if ( container_.verts().size() < 3 )
     throw std::logic_error("not enough points for triangulation");
 
+  allocBase_ = iAlloc::threadSample().current_;
+
   //cw_ = iMath::cw_dir(container_.verts());
 
   boundary_.resize(container_.verts().size());
@@ -27,60 +41,327 @@ DelaunayTriangulator::DelaunayTriangulator(Vertices & verts) :
 
   dimensionThreshold_ = rect_.diagonal().length() * 0.3;
 
-  int depth = 5;
-  octree_.reset( new OcTree<OrEdge>(rect_, depth) );
+  octree_.reset( new OcTree<OrEdge>(rect_, indexDepth) );
 
+  // before the pool, so that its workers are counted
+  if ( options_.perfCounters_ )
+    perf_.reset( new PerfCounters );
+
+  if ( options_.threads_ > 1 )
+    pool_.reset( new TaskPool(options_.threads_) );
+  queries_.resize(pool_ ? pool_->threadsCount() : 1);
+
+  beginStage("prebuild");
   prebuild();
+  endStage();
 }
 
 DelaunayTriangulator::~DelaunayTriangulator()
 {
 }
 
+const TriangulationStats & DelaunayTriangulator::stats() const
+{
+  updateIndexStats();
+  return stats_;
+}
+
+void DelaunayTriangulator::beginStage(const char * name)
+{
+  stage_ = StageStats();
+  stage_.name_ = name;
+  if ( perf_ )
+    perfStart_ = perf_->read();
+  iAlloc::resetThreadPeak();
+  stage_.alloc_ = iAlloc::threadSample();
+  stageStart_ = boost::chrono::steady_clock::now();
+}
+
+void DelaunayTriangulator::endStage()
+{
+  boost::chrono::duration<double> d = boost::chrono::steady_clock::now() - stageStart_;
+  stage_.seconds_ = d.count();
+  stage_.edges_ = container_.edges().size();
+  if ( perf_ )
+    stage_.perf_ = perf_->read() - perfStart_;
+
+  stage_.alloc_ = iAlloc::threadSample() - stage_.alloc_;
+  stage_.alloc_.current_ -= allocBase_;
+  stage_.alloc_.peak_ -= allocBase_;
+  stats_.peakBytes_ = std::max(stats_.peakBytes_, stage_.alloc_.peak_);
+
+  stats_.stages_.push_back(stage_);
+}
+
+void DelaunayTriangulator::updateIndexStats() const
+{
+  stats_.octreeAdds_ = octree_->addsCount();
+  stats_.octreeRemoves_ = octree_->removesCount();
+  stats_.octreeCollects_ = octree_->collectsCount();
+  stats_.octreeCollected_ = octree_->collectedCount();
+
+  IndexQueryStats * totals[QueriesN] = { &stats_.selfIsectEdge_, &stats_.selfIsectTri_, &stats_.crossSections_ };
+  for (int k = 0; k < QueriesN; ++k)
+    *totals[k] = IndexQueryStats();
+
+  for (size_t i = 0; i < queries_.size(); ++i)
+  {
+    const WorkerQueries & worker = queries_[i];
+    stats_.octreeCollects_ += worker.collects_;
+    stats_.octreeCollected_ += worker.collected_;
+    for (int k = 0; k < QueriesN; ++k)
+    {
+      totals[k]->queries_ += worker.queries_[k].queries_;
+      totals[k]->candidates_ += worker.queries_[k].candidates_;
+      totals[k]->overlapping_ += worker.queries_[k].overlapping_;
+      totals[k]->hits_ += worker.queries_[k].hits_;
+    }
+  }
+
+  if ( options_.indexDiagnostics_ )
+    octree_->diagnostics(stats_.octree_);
+}
+
+DelaunayTriangulator::WorkerQueries & DelaunayTriangulator::workerQueries() const
+{
+  return queries_[pool_ ? pool_->workerIndex() : 0];
+}
+
+void DelaunayTriangulator::collect(IndexQuery query, const Rect3f & rc, EdgesSet_const & items) const
+{
+  octree_->find(rc, items);
+
+  WorkerQueries & worker = workerQueries();
+  if ( worker.task_ )
+    worker.task_->index_->find(rc, items);
+
+  worker.collects_++;
+  worker.collected_ += items.size();
+  countQuery(worker.queries_[query], rc, items);
+}
+
+void DelaunayTriangulator::countHit(IndexQuery query) const
+{
+  workerQueries().queries_[query].hits_++;
+}
+
+void DelaunayTriangulator::countQuery(IndexQueryStats & query, const Rect3f & rc, const EdgesSet_const & items) const
+{
+  query.queries_++;
+  query.candidates_ += items.size();
+
+  if ( !options_.indexDiagnostics_ )
+    return;
+
+  for (EdgesSet_const::const_iterator i = items.begin(); i != items.end(); ++i)
+  {
+    if ( rc.intersecting((*i)->rect()) )
+      query.overlapping_++;
+  }
+}
+
 void DelaunayTriangulator::triangulate(Triangles & tris)
 {
-  save3d("D:\\Scenes\\3dpad\\intrusion.txt", "Mesh", "Boundary", "Normals");
+  STAGE_TIMER("triangulate");
+  TRACE_SCOPE("triangulate");
+
+  DO_DUMP( save3d("D:\\Scenes\\3dpad\\intrusion.txt", "Mesh", "Boundary", "Normals") );
+
+  // flips can't make flat mesh self-intersecting
+  if ( !planar_ && !projected_ )
+  {
+    beginStage("untangle");
+    untangle(true);
+    endStage();
+  }
 
-  makeDelaunayRep(true);
+  beginStage(planar_ ? "makeDelaunay(flat)" : projected_ ? "makeDelaunay(proj)" : "makeDelaunay(SI)");
+  makeDelaunayRep(!planar_);
+  endStage();
 
-  save3d("D:\\Scenes\\3dpad\\intrusion_delaunay.txt", "Mesh", "Boundary", "Normals");
+  DO_DUMP( save3d("D:\\Scenes\\3dpad\\intrusion_delaunay.txt", "Mesh", "Boundary", "Normals") );
 
+  beginStage("split");
   split();
+  endStage();
 
+  beginStage("makeDelaunay");
   makeDelaunayRep(false);
+  endStage();
 
-  save3d("D:\\Scenes\\3dpad\\splitted_delaunay.txt", "Mesh", "Boundary", "Normals");
+  // split and flips above don't keep the index and don't check self-intersections
+  if ( !planar_ && !projected_ )
+  {
+    beginStage("untangle(split)");
+    untangle(false);
+    endStage();
+  }
 
-  smooth(2);
+  DO_DUMP( save3d("D:\\Scenes\\3dpad\\splitted_delaunay.txt", "Mesh", "Boundary", "Normals") );
 
-  save3d("D:\\Scenes\\3dpad\\splitted_delaunay_smooth.txt", "Mesh", 0, 0);
+  if ( options_.fairing_ > 0 )
+  {
+    beginStage("fair");
+    fair(options_.fairing_);
+    endStage();
+  }
+  else
+  {
+    beginStage("smooth");
+    smooth(options_.smoothIterations_);
+    endStage();
+  }
 
-  postbuild(tris);
+  DO_DUMP( save3d("D:\\Scenes\\3dpad\\splitted_delaunay_smooth.txt", "Mesh", 0, 0) );
+
+  beginStage("postbuild");
+  postbuild(tris, options_.meshQuality_ ? &stats_.quality_ : 0);
+  endStage();
+
+  updateIndexStats();
+
+  if ( options_.optimizeOrder_ )
+    iMesh::optimizeVertexCache(tris, container_.verts().size(), options_.cacheSize_);
+
+  if ( options_.renumberVertices_ )
+  {
+    std::vector<int> remap;
+    iMesh::optimizeVertexFetch(container_.verts(), tris, boundary_.size(), remap);
+    container_.renumber(remap);
+  }
 }
 
-void DelaunayTriangulator::split()
+/**
+  Inner edges not shorter than threshold, one half of each.
+  With longestFirst the queue is a max-heap by length, ties go by id. Entries aren't removed when edge changes,
+  instead the length is checked when it comes to the top and the edge is requeued if it was changed.
+  Otherwise edges are taken in order of ids, every half is queued only once
+*/
+class DelaunayTriangulator::SplitQueue
 {
-  EdgesSet to_split, to_exclude;
+public:
 
-  for (OrEdgesList_shared::iterator i = container_.edges().begin(); i != container_.edges().end(); ++i)
+  SplitQueue(bool longestFirst, double threshold, size_t & stale) :
+    longestFirst_(longestFirst), threshold_(threshold), stale_(stale)
+  {}
+
+  bool empty() const
+  {
+    return longestFirst_ ? heap_.empty() : set_.empty();
+  }
+
+  void push(OrEdge * e)
   {
-    OrEdge * e = i->get();
     OrEdge * a = e->get_adjacent();
-    if ( !a || e->length() < splitThreshold_ )
-      continue;
+    if ( !a )
+      return;
 
-    if ( to_exclude.find(e) != to_exclude.end() )
-      continue;
+    double length = e->length();
+    if ( length < threshold_ )
+      return;
 
-    to_split.insert(e);
-    to_exclude.insert(a);
+    if ( !longestFirst_ )
+    {
+      if ( exclude_.find(e) != exclude_.end() )
+        return;
+
+      set_.insert(e);
+      exclude_.insert(a);
+      return;
+    }
+
+    if ( a->id() < e->id() )
+      e = a;
+
+    if ( (size_t)e->id() >= queued_.size() )
+      queued_.resize(e->id()*2 + 1, 0);
+
+    if ( queued_[e->id()] )
+      return;
+
+    queued_[e->id()] = 1;
+    heap_.push_back(Entry(length, e));
+    std::push_heap(heap_.begin(), heap_.end());
   }
 
+  // 0 if there is nothing to split
+  OrEdge * pop()
+  {
+    if ( !longestFirst_ )
+    {
+      if ( set_.empty() )
+        return 0;
+
+      OrEdge * e = *set_.begin();
+      set_.erase(set_.begin());
+      return e;
+    }
+
+    while ( !heap_.empty() )
+    {
+      std::pop_heap(heap_.begin(), heap_.end());
+      Entry top = heap_.back();
+      heap_.pop_back();
+
+      OrEdge * e = top.edge_;
+      queued_[e->id()] = 0;
+      if ( e->length() == top.length_ )
+        return e;
+
+      // edge was rotated or split after it was queued
+      stale_++;
+      push(e);
+    }
+
+    return 0;
+  }
+
+private:
+
+  struct Entry
+  {
+    Entry(double length, OrEdge * edge) : length_(length), edge_(edge) {}
+
+    bool operator < (const Entry & other) const
+    {
+      if ( length_ != other.length_ )
+        return length_ < other.length_;
+      return edge_->id() > other.edge_->id();
+    }
+
+    double length_;
+    OrEdge * edge_;
+  };
+
+  bool longestFirst_;
+  double threshold_;
+  size_t & stale_;
+
+  std::vector<Entry> heap_;
+  std::vector<char> queued_;
+
+  EdgesSet set_, exclude_;
+};
+
+void DelaunayTriangulator::split()
+{
+  STAGE_TIMER("split");
+  TRACE_SCOPE("split");
+
+  SplitQueue to_split(options_.longestFirst_, splitThreshold_, stats_.splitStale_);
+
+  for (OrEdgesList_shared::iterator i = container_.edges().begin(); i != container_.edges().end(); ++i)
+    to_split.push(i->get());
+
+  TRACE_BATCH("split batch", 1024);
+
   for (int n = 0; !to_split.empty(); ++n)
   {
-    EdgesSet::iterator iter = to_split.begin();
-    OrEdge * e = *iter;
-    to_split.erase(iter);
+    TRACE_BATCH_TICK();
+
+    OrEdge * e = to_split.pop();
+    if ( !e )
+      break;
 
     OrEdge * adj = e->get_adjacent();
     if ( !adj )
@@ -99,6 +380,8 @@ void DelaunayTriangulator::split()
     if ( !e->splitEdge(index) )
       throw std::runtime_error("couldn't split edge");
 
+    stats_.edgesSplit_++;
+
     OrEdge * a1 = e->prev();
     OrEdge * b1 = a1->get_adjacent();
     OrEdge * c1 = b1->prev();
@@ -137,34 +420,39 @@ void DelaunayTriangulator::split()
     to_delanay.insert(lprev);
     to_delanay.insert(c2next);
 
-    makeDelaunay(to_delanay, to_split, to_exclude);
+    makeDelaunay(to_delanay, to_split);
 
     // added edges could be changed while makeDelaunay, so we add them after
     for (EdgesList::iterator i = egs.begin(); i != egs.end(); ++i)
-    {
-      OrEdge * g = *i;
-      OrEdge * a = g->get_adjacent();
-      double L = g->length();
-      if ( !a || L < splitThreshold_ )
-        continue;
-
-      if ( to_exclude.find(g) != to_exclude.end() )
-        continue;
-
-      to_split.insert(g);
-      to_exclude.insert(a);
-    }
+      to_split.push(*i);
   }
 }
 
 void DelaunayTriangulator::makeDelaunayRep(bool checkSI)
 {
+  STAGE_TIMER(checkSI ? "makeDelaunay(SI)" : "makeDelaunay");
+  TRACE_SCOPE(checkSI ? "makeDelaunay(SI)" : "makeDelaunay");
+
+  stats_.flipLoops_.push_back(FlipLoopStats());
+  FlipLoopStats & loop = stats_.flipLoops_.back();
+  loop.checkSI_ = checkSI;
+
+  if ( !checkSI && options_.flipRounds_ )
+  {
+    makeDelaunayRounds(loop);
+    return;
+  }
+
   int num = std::numeric_limits<int>::max(), repsN = 0;
   for ( ;; )
   {
-    int n = makeDelaunay(checkSI);
+    loop.passes_.push_back(FlipPassStats());
+    int n = makeDelaunay(checkSI, loop.passes_.back());
     if ( n == 0 )
+    {
+      loop.converged_ = true;
       break;
+    }
 
     if ( n >= num )
       repsN++;
@@ -177,8 +465,140 @@ void DelaunayTriangulator::makeDelaunayRep(bool checkSI)
   }
 }
 
-int DelaunayTriangulator::makeDelaunay(bool checkSI)
+void DelaunayTriangulator::forEach(size_t n, const TaskPool::Range & body)
+{
+  if ( pool_ )
+    pool_->parallelFor(n, 256, body);
+  else
+    body(0, n);
+}
+
+namespace
+{
+  // quad of edge and its adjacent
+  void quadVertices(const OrEdge * e, int v[4])
+  {
+    v[0] = e->org();
+    v[1] = e->dst();
+    v[2] = e->next()->dst();
+    v[3] = e->get_adjacent()->next()->dst();
+  }
+
+  // the half with the smaller id stands for the pair, 0 for boundary edge
+  OrEdge * inner(OrEdge * e)
+  {
+    OrEdge * a = e->get_adjacent();
+    if ( !a )
+      return 0;
+    return a->id() < e->id() ? a : e;
+  }
+}
+
+void DelaunayTriangulator::makeDelaunayRounds(FlipLoopStats & loop)
+{
+  TRACE_SCOPE("rounds");
+
+  std::vector<OrEdge*> dirty, chosen, next;
+  for (OrEdgesList_shared::iterator i = container_.edges().begin(); i != container_.edges().end(); ++i)
+  {
+    OrEdge * e = i->get();
+    if ( inner(e) == e )
+      dirty.push_back(e);
+  }
+
+  // flips in one round don't share vertices, so they don't see each other's edges,
+  // even when OrEdge::rotate walks around a vertex looking for existing connection
+  std::vector<char> used(container_.verts().size(), 0);
+  std::vector<char> flags;
+
+  const int roundsMax = 256;
+  for (int round = 0; !dirty.empty(); ++round)
+  {
+    if ( round == roundsMax )
+      return;
+
+    loop.passes_.push_back(FlipPassStats());
+    FlipPassStats & pass = loop.passes_.back();
+    pass.tested_ = dirty.size();
+    stats_.needRotateCalls_ += dirty.size();
+
+    flags.assign(dirty.size(), 0);
+    forEach(dirty.size(), boost::bind(&DelaunayTriangulator::testEdges, this, boost::cref(dirty), boost::ref(flags), boost::placeholders::_1, boost::placeholders::_2));
+
+    // greedy independent set in order of ids, the rest waits for the next round
+    chosen.clear();
+    next.clear();
+    for (size_t i = 0; i < dirty.size(); ++i)
+    {
+      if ( !flags[i] )
+        continue;
+
+      int v[4];
+      quadVertices(dirty[i], v);
+      if ( used[v[0]] || used[v[1]] || used[v[2]] || used[v[3]] )
+      {
+        next.push_back(dirty[i]);
+        continue;
+      }
+
+      for (int j = 0; j < 4; ++j)
+        used[v[j]] = 1;
+      chosen.push_back(dirty[i]);
+    }
+
+    flags.assign(chosen.size(), 0);
+    forEach(chosen.size(), boost::bind(&DelaunayTriangulator::rotateEdges, this, boost::cref(chosen), boost::ref(flags), boost::placeholders::_1, boost::placeholders::_2));
+
+    // edges of changed triangles are tested again
+    for (size_t i = 0; i < chosen.size(); ++i)
+    {
+      OrEdge * e = chosen[i];
+      int v[4];
+      quadVertices(e, v);
+      for (int j = 0; j < 4; ++j)
+        used[v[j]] = 0;
+
+      if ( !flags[i] )
+      {
+        stats_.rotateRejected_++;
+        pass.rejectedConnection_++;
+        continue;
+      }
+
+      pass.flipped_++;
+      OrEdge * quad[4] = { e->next(), e->next()->next(), e->get_adjacent()->next(), e->get_adjacent()->next()->next() };
+      next.push_back(e);
+      for (int j = 0; j < 4; ++j)
+      {
+        if ( OrEdge * q = inner(quad[j]) )
+          next.push_back(q);
+      }
+    }
+
+    std::sort(next.begin(), next.end(), OrEdgeLess());
+    next.erase(std::unique(next.begin(), next.end()), next.end());
+    dirty.swap(next);
+  }
+
+  loop.converged_ = true;
+}
+
+void DelaunayTriangulator::testEdges(const std::vector<OrEdge*> & edges, std::vector<char> & flags, size_t begin, size_t end) const
+{
+  for (size_t i = begin; i < end; ++i)
+    flags[i] = testRotate(edges[i], false, 0);
+}
+
+void DelaunayTriangulator::rotateEdges(const std::vector<OrEdge*> & edges, std::vector<char> & flags, size_t begin, size_t end)
+{
+  for (size_t i = begin; i < end; ++i)
+    flags[i] = edges[i]->rotate();
+}
+
+int DelaunayTriangulator::makeDelaunay(bool checkSI, FlipPassStats & pass)
 {
+  TRACE_SCOPE("pass");
+
   EdgesSet to_delanay, to_exclude;
   for (OrEdgesList_shared::iterator i = container_.edges().begin(); i != container_.edges().end(); ++i)
   {
@@ -191,16 +611,27 @@ int DelaunayTriangulator::makeDelaunay(bool checkSI)
     to_exclude.insert(a);
   }
 
+  if ( checkSI && pool_ && options_.speculativeSI_ && !projected_ )
+    return makeDelaunaySpeculative(to_delanay, pass);
+
   int num = 0;
   for (EdgesSet::iterator i = to_delanay.begin(); i != to_delanay.end(); ++i)
   {
     OrEdge * e = *i;
-    if ( !needRotate(e, checkSI) )
+    bool rejectedSI = false;
+    pass.tested_++;
+    if ( !needRotate(e, checkSI, &rejectedSI) )
+    {
+      if ( rejectedSI )
+        pass.rejectedSI_++;
       continue;
+    }
 
     OrEdge * a = e->get_adjacent();
 
-    if ( checkSI )
+    // index is not queried for projected boundary
+    bool indexed = checkSI && !projected_;
+    if ( indexed )
     {
       octree_->remove(e);
       octree_->remove(a);
@@ -208,88 +639,338 @@ int DelaunayTriangulator::makeDelaunay(bool checkSI)
 
     if ( e->rotate() )
       num++;
+    else
+    {
+      stats_.rotateRejected_++;
+      pass.rejectedConnection_++;
+    }
 
-    if ( checkSI )
+    if ( indexed )
     {
       octree_->add(e);
       octree_->add(a);
     }
   }
 
+  TRACE_ARG("candidates", (double)to_delanay.size());
+  TRACE_ARG("rotations", num);
+
+  pass.flipped_ = num;
   return num;
 }
 
-void DelaunayTriangulator::makeDelaunay(EdgesSet & to_delanay, EdgesSet & to_split, EdgesSet & to_exclude)
+void DelaunayTriangulator::reindex()
 {
-  EdgesList egs;
-  for (int n = 0; !to_delanay.empty(); ++n)
-  {
-    EdgesSet::iterator i = to_delanay.begin();
-    OrEdge * e = *i;
-    to_delanay.erase(i);
-
-    if ( !needRotate(e, false) )
-      continue;
-
-    //OrEdge * a = e->get_adjacent();
-    //octree_->remove(e);
-    //octree_->remove(a);
+  octree_->clear();
+  for (OrEdgesList_shared::iterator i = container_.edges().begin(); i != container_.edges().end(); ++i)
+    octree_->add(i->get());
+}
 
-    if ( !e->rotate() )
-      continue;
+/**
+  Ear clipping of folded boundary can leave triangles crossing each other, when every cut of some sub-polygon
+  crosses triangles clipped before, and so can flips made without self-intersection checks.
+  Crossing triangles are found on a grid, then their edges are rotated if the new triangles cross fewer triangles
+  than the old ones. Repeated while the number of crossings goes down. The index is rebuilt first if it isn't kept up to date
+*/
+void DelaunayTriangulator::untangle(bool indexed)
+{
+  STAGE_TIMER("untangle");
+  TRACE_SCOPE("untangle");
 
-    //octree_->add(e);
-    //octree_->add(a);
+  size_t crossingsN = std::numeric_limits<size_t>::max();
+  for ( ;; )
+  {
+    // triangles and their first edges, ids of edges are sequential
+    Triangles tris;
+    std::vector<OrEdge*> firsts;
+    std::vector<char> used(container_.edges().size(), 0);
+    for (OrEdgesList_shared::iterator i = container_.edges().begin(); i != container_.edges().end(); ++i)
+    {
+      OrEdge * e = i->get();
+      if ( used[e->id()] || e->next()->next()->next() != e )
+        continue;
 
-    OrEdge * rnext = e->next();
-    OrEdge * rprev = e->prev();
+      used[e->id()] = used[e->next()->id()] = used[e->next()->next()->id()] = 1;
+      tris.push_back(e->tri());
+      firsts.push_back(e);
+    }
 
-    OrEdge * lnext = e->get_adjacent()->next();
-    OrEdge * lprev = e->get_adjacent()->prev();
+    std::vector< std::pair<int, int> > pairs;
+    iMesh::findSelfIntersections(container_.verts(), tris, pairs);
+    if ( pairs.empty() || pairs.size() >= crossingsN )
+      return;
 
-    egs.push_back(rnext);
-    egs.push_back(rprev);
-    egs.push_back(lnext);
-    egs.push_back(lprev);
+    crossingsN = pairs.size();
 
-    for (EdgesList::iterator j = egs.begin(); j != egs.end(); ++j)
+    if ( !indexed )
     {
-      OrEdge * g = *j;
-      to_delanay.insert(g);
+      reindex();
+      indexed = true;
+    }
 
-      OrEdge * a = g->get_adjacent();
-      if ( !a || g->length() < splitThreshold_ )
-        continue;
+    std::vector<int> crossing;
+    for (size_t i = 0; i < pairs.size(); ++i)
+    {
+      crossing.push_back(pairs[i].first);
+      crossing.push_back(pairs[i].second);
+    }
+    std::sort(crossing.begin(), crossing.end());
+    crossing.erase(std::unique(crossing.begin(), crossing.end()), crossing.end());
 
-      if ( to_exclude.find(g) != to_exclude.end() )
+    for (size_t i = 0; i < crossing.size(); ++i)
+    {
+      // triangle could be changed by rotations made before
+      OrEdge * e = firsts[crossing[i]];
+      Triangle tr = e->tri();
+      const Triangle & was = tris[crossing[i]];
+      if ( e->next()->next()->next() != e || tr.x != was.x || tr.y != was.y || tr.z != was.z )
         continue;
 
-      to_split.insert(g);
-      to_exclude.insert(a);
+      for (int k = 0; k < 3; ++k, e = e->next())
+      {
+        OrEdge * a = e->get_adjacent();
+        if ( !a || a->next()->next()->next() != a )
+          continue;
+
+        int i0 = e->next()->dst();
+        int i1 = a->next()->dst();
+        Triangle tr0(e->org(), i0, i1);
+        Triangle tr1(e->dst(), i1, i0);
+        if ( !hasArea(tr0) || !hasArea(tr1) || crossings(tr0) + crossings(tr1) >= crossings(e->tri()) + crossings(a->tri()) )
+          continue;
+
+        octree_->remove(e);
+        octree_->remove(a);
+
+        bool rotated = e->rotate();
+
+        octree_->add(e);
+        octree_->add(a);
+
+        if ( rotated )
+        {
+          stats_.untangleFlips_++;
+          break;
+        }
+      }
     }
   }
 }
 
-Vec3f DelaunayTriangulator::calcPt(const Vec3f & p0, const Vec3f & p1, const Vec3f & n0, const Vec3f & n1, double t) const
+namespace
 {
-  Vec3f dir = p1 - p0;
-  if ( dir.length() > iMath::err )
-    dir.normalize();
-  else
-    return p0;
+  // coarse bitmap of space changed by flips, marks are conservative
+  class DirtyGrid
+  {
+  public:
 
-  Vec3f x0 = n0 ^ dir;
-  if ( x0.length() > iMath::err )
-    x0.normalize();
+    DirtyGrid(const Rect3f & rect, double cell) : rect_(rect)
+    {
+      Vec3f d = rect.diagonal();
+      double size[3] = { d.x, d.y, d.z };
+      for (int k = 0; k < 3; ++k)
+      {
+        n_[k] = cell > 0 ? std::max(1, std::min(64, (int)(size[k]/cell) + 1)) : 1;
+        scale_[k] = size[k] > 0 ? n_[k]/size[k] : 0;
+      }
+      cells_.assign(n_[0]*n_[1]*n_[2], 0);
+    }
 
-  Vec3f x1 = n1 ^ dir;
-  if ( x1.length() > iMath::err )
-    x1.normalize();
+    void mark(const Rect3f & rc)
+    {
+      int lo[3], hi[3];
+      range(rc, lo, hi);
+      for (int x = lo[0]; x <= hi[0]; ++x)
+        for (int y = lo[1]; y <= hi[1]; ++y)
+          for (int z = lo[2]; z <= hi[2]; ++z)
+            cells_[(x*n_[1] + y)*n_[2] + z] = 1;
+    }
 
-  Vec3f r0 = x0 ^ n0;
-  Vec3f r1 = x1 ^ n1;
+    bool touched(const Rect3f & rc) const
+    {
+      int lo[3], hi[3];
+      range(rc, lo, hi);
+      for (int x = lo[0]; x <= hi[0]; ++x)
+        for (int y = lo[1]; y <= hi[1]; ++y)
+          for (int z = lo[2]; z <= hi[2]; ++z)
+            if ( cells_[(x*n_[1] + y)*n_[2] + z] )
+              return true;
+      return false;
+    }
 
-  if ( r0.length() > iMath::err )
+  private:
+
+    void range(const Rect3f & rc, int lo[3], int hi[3]) const
+    {
+      double vmin[3] = { rc.vmin.x - rect_.vmin.x, rc.vmin.y - rect_.vmin.y, rc.vmin.z - rect_.vmin.z };
+      double vmax[3] = { rc.vmax.x - rect_.vmin.x, rc.vmax.y - rect_.vmin.y, rc.vmax.z - rect_.vmin.z };
+      for (int k = 0; k < 3; ++k)
+      {
+        lo[k] = std::max(0, std::min(n_[k]-1, (int)floor(vmin[k]*scale_[k])));
+        hi[k] = std::max(0, std::min(n_[k]-1, (int)floor(vmax[k]*scale_[k])));
+      }
+    }
+
+    Rect3f rect_;
+    int n_[3];
+    double scale_[3];
+    std::vector<char> cells_;
+  };
+
+  Rect3f quadRect(const Vertices & verts, const int v[4])
+  {
+    Rect3f rc;
+    for (int j = 0; j < 4; ++j)
+      rc.add(verts[v[j]].p());
+    return rc;
+  }
+}
+
+/**
+  needRotate of all candidates is evaluated in parallel against the mesh as it was before the pass,
+  then flips are made in order. Candidate is tested again if its quad changed or if some flip was
+  made in space its self-intersection queries could see. The result is the same as of sequential pass
+*/
+int DelaunayTriangulator::makeDelaunaySpeculative(const EdgesSet & to_delanay, FlipPassStats & pass)
+{
+  TRACE_SCOPE("speculative");
+
+  std::vector<OrEdge*> edges(to_delanay.begin(), to_delanay.end());
+  std::vector<char> results(edges.size(), 0);
+  std::vector<int> quads(edges.size()*4);
+  forEach(edges.size(), boost::bind(&DelaunayTriangulator::speculate, this, boost::cref(edges), boost::ref(results),
+    boost::ref(quads), boost::placeholders::_1, boost::placeholders::_2));
+
+  DirtyGrid dirty(rect_, edgeLength_);
+  int num = 0;
+  for (size_t i = 0; i < edges.size(); ++i)
+  {
+    OrEdge * e = edges[i];
+    int v[4];
+    quadVertices(e, v);
+    Rect3f rc = quadRect(container_.verts(), v);
+
+    char result = results[i];
+    if ( !std::equal(v, v+4, &quads[i*4]) || dirty.touched(rc) )
+    {
+      bool rejectedSI = false;
+      result = testRotate(e, true, &rejectedSI) ? Rotate : (rejectedSI ? RejectedSI : Keep);
+      pass.revalidated_++;
+    }
+
+    pass.tested_++;
+    stats_.needRotateCalls_++;
+    if ( result != Rotate )
+    {
+      if ( result == RejectedSI )
+        pass.rejectedSI_++;
+      continue;
+    }
+
+    OrEdge * a = e->get_adjacent();
+    octree_->remove(e);
+    octree_->remove(a);
+
+    if ( e->rotate() )
+    {
+      num++;
+      dirty.mark(rc);
+    }
+    else
+    {
+      stats_.rotateRejected_++;
+      pass.rejectedConnection_++;
+    }
+
+    octree_->add(e);
+    octree_->add(a);
+  }
+
+  TRACE_ARG("candidates", (double)to_delanay.size());
+  TRACE_ARG("rotations", num);
+
+  pass.flipped_ = num;
+  return num;
+}
+
+void DelaunayTriangulator::speculate(const std::vector<OrEdge*> & edges, std::vector<char> & results, std::vector<int> & quads, size_t begin, size_t end) const
+{
+  for (size_t i = begin; i < end; ++i)
+  {
+    quadVertices(edges[i], &quads[i*4]);
+
+    bool rejectedSI = false;
+    results[i] = testRotate(edges[i], true, &rejectedSI) ? Rotate : (rejectedSI ? RejectedSI : Keep);
+  }
+}
+
+void DelaunayTriangulator::makeDelaunay(EdgesSet & to_delanay, SplitQueue & to_split)
+{
+  EdgesList egs;
+  for (int n = 0; !to_delanay.empty(); ++n)
+  {
+    EdgesSet::iterator i = to_delanay.begin();
+    OrEdge * e = *i;
+    to_delanay.erase(i);
+
+    if ( !needRotate(e, false) )
+      continue;
+
+    //OrEdge * a = e->get_adjacent();
+    //octree_->remove(e);
+    //octree_->remove(a);
+
+    if ( !e->rotate() )
+    {
+      stats_.rotateRejected_++;
+      continue;
+    }
+
+    stats_.refineRotations_++;
+
+    //octree_->add(e);
+    //octree_->add(a);
+
+    OrEdge * rnext = e->next();
+    OrEdge * rprev = e->prev();
+
+    OrEdge * lnext = e->get_adjacent()->next();
+    OrEdge * lprev = e->get_adjacent()->prev();
+
+    egs.push_back(rnext);
+    egs.push_back(rprev);
+    egs.push_back(lnext);
+    egs.push_back(lprev);
+
+    for (EdgesList::iterator j = egs.begin(); j != egs.end(); ++j)
+    {
+      OrEdge * g = *j;
+      to_delanay.insert(g);
+      to_split.push(g);
+    }
+  }
+}
+
+Vec3f DelaunayTriangulator::calcPt(const Vec3f & p0, const Vec3f & p1, const Vec3f & n0, const Vec3f & n1, double t) const
+{
+  Vec3f dir = p1 - p0;
+  if ( dir.length() > iMath::err )
+    dir.normalize();
+  else
+    return p0;
+
+  Vec3f x0 = n0 ^ dir;
+  if ( x0.length() > iMath::err )
+    x0.normalize();
+
+  Vec3f x1 = n1 ^ dir;
+  if ( x1.length() > iMath::err )
+    x1.normalize();
+
+  Vec3f r0 = x0 ^ n0;
+  Vec3f r1 = x1 ^ n1;
+
+  if ( r0.length() > iMath::err )
     r0.normalize();
 
   if ( r1.length() > iMath::err )
@@ -351,11 +1032,19 @@ bool DelaunayTriangulator::getSplitPoint(const OrEdge * edge, Vertex & v) const
   return true;
 }
 
-bool DelaunayTriangulator::needRotate(const OrEdge * edge, bool checkSI) const
+bool DelaunayTriangulator::needRotate(const OrEdge * edge, bool checkSI, bool * rejectedSI) const
 {
   if ( !edge )
     return false;
-  
+
+  stats_.needRotateCalls_++;
+  return testRotate(edge, checkSI, rejectedSI);
+}
+
+bool DelaunayTriangulator::testRotate(const OrEdge * edge, bool checkSI, bool * rejectedSI) const
+{
+  STAGE_TIMER("needRotate");
+
   const OrEdge * adj = edge->get_adjacent();
   if ( !adj )
     return false;
@@ -375,7 +1064,42 @@ bool DelaunayTriangulator::needRotate(const OrEdge * edge, bool checkSI) const
   if ( dist_l.length() < rotateThreshold_ || outside )
     return false;
 
-  // now check Delaunay criteria
+  if ( isDelaunay(edge) )
+    return false;
+
+  if ( checkSI && projected_ )
+  {
+    if ( foldsProjection(edge) )
+    {
+      if ( rejectedSI )
+        *rejectedSI = true;
+      return false;
+    }
+  }
+  // self-intersections
+  else if ( checkSI )
+  {
+    int i0 = edge->next()->dst();
+    int i1 = adj->next()->dst();
+    OrEdge temp(i0, i1, const_cast<EdgesContainer*>(&container_));
+    Triangle tr0(edge->org(), i0, i1);
+    Triangle tr1(edge->dst(), i1, i0);
+    if ( selfIsect(&temp) || selfIsect(tr0) || selfIsect(tr1) )
+    {
+      if ( rejectedSI )
+        *rejectedSI = true;
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// sum of angles opposite to edge should not exceed pi
+bool DelaunayTriangulator::isDelaunay(const OrEdge * edge) const
+{
+  const OrEdge * adj = edge->get_adjacent();
+
   Vec3f r1 = -edge->next()->dir();
   Vec3f r2 =  edge->prev()->dir();
 
@@ -389,52 +1113,100 @@ bool DelaunayTriangulator::needRotate(const OrEdge * edge, bool checkSI) const
   iMath::sincos(r3, r4, sb, cb);
 
   double dln = sa*cb + sb*ca;
-  if ( dln > -iMath::err )
-    return false;
+  return dln > -iMath::err;
+}
 
-  // self-intersections
-  if ( checkSI )
+void DelaunayTriangulator::postbuild(Triangles & tris, MeshQualityStats * quality) const
+{
+  STAGE_TIMER("postbuild");
+  TRACE_SCOPE("postbuild");
+
+  tris.reserve(tris.size() + container_.edges().size()/3);
+
+  for (OrEdgesList_shared::const_iterator i = container_.edges().begin(); i != container_.edges().end(); ++i)
   {
-    int i0 = edge->next()->dst();
-    int i1 = adj->next()->dst();
-    OrEdge temp(i0, i1, const_cast<EdgesContainer*>(&container_));
-    if ( selfIsect(&temp) )
-      return false;
+    const OrEdge * e = i->get();
+    const OrEdge * n = e->next();
+    const OrEdge * p = n->next();
 
-    Triangle tr0(edge->org(), i0, i1);
-    if ( selfIsect(tr0) )
-      return false;
+    if ( p->next() != e )
+      continue;
 
-    Triangle tr1(edge->dst(), i1, i0);
-    if ( selfIsect(tr1) )
-      return false;
+    if ( quality )
+      measureEdge(e, *quality);
+
+    // triangle is emitted once, by the edge created first
+    if ( n->id() < e->id() || p->id() < e->id() )
+      continue;
+
+    tris.push_back(e->tri());
+
+    if ( quality )
+      measureTriangle(tris.back(), *quality);
   }
+}
 
-  return true;
+void DelaunayTriangulator::measureEdge(const OrEdge * e, MeshQualityStats & quality) const
+{
+  // inner edge is measured once, by the half created first
+  const OrEdge * adj = e->get_adjacent();
+  if ( adj && adj->id() < e->id() )
+    return;
+
+  double len = edgeLength_ > 0 ? e->length() / edgeLength_ : 0;
+  if ( quality.edges_ == 0 || len < quality.minLength_ )
+    quality.minLength_ = len;
+  if ( quality.edges_ == 0 || len > quality.maxLength_ )
+    quality.maxLength_ = len;
+  quality.sumLength_ += len;
+  quality.sumLength2_ += len*len;
+  quality.edges_++;
+
+  if ( adj && adj->next()->next()->next() == adj && !isDelaunay(e) )
+    quality.nonDelaunay_++;
 }
 
-void DelaunayTriangulator::postbuild(Triangles & tris) const
+void DelaunayTriangulator::measureTriangle(const Triangle & tr, MeshQualityStats & quality) const
 {
-  EdgesSet_const used;
-  for (OrEdgesList_shared::const_iterator i = container_.edges().begin(); i != container_.edges().end(); ++i)
+  const Vec3f * p[3] = { &container_.verts()[tr.x].p(), &container_.verts()[tr.y].p(), &container_.verts()[tr.z].p() };
+
+  double minAngle = 180, maxAngle = 0, maxLength = 0, perimeter = 0;
+  for (int i = 0; i < 3; ++i)
   {
-    const OrEdge * e = i->get();
-    if ( used.find(e) != used.end() )
-      continue;
+    Vec3f a = *p[(i+1)%3] - *p[i];
+    Vec3f b = *p[(i+2)%3] - *p[i];
+    double la = a.length(), lb = b.length();
+    double angle = 0;
+    if ( la > iMath::err && lb > iMath::err )
+    {
+      double c = (a*b) / (la*lb);
+      angle = acos(std::max(-1.0, std::min(1.0, c))) * (180.0 / 3.14159265358979);
+    }
+    minAngle = std::min(minAngle, angle);
+    maxAngle = std::max(maxAngle, angle);
+    maxLength = std::max(maxLength, la);
+    perimeter += la;
+  }
 
-    if ( e->next()->next()->next() != e )
-      continue;
+  quality.minAngle_[std::min((int)(minAngle/10), (int)MeshQualityStats::AngleBins-1)]++;
+  quality.maxAngle_[std::min((int)(maxAngle/10), (int)MeshQualityStats::AngleBins-1)]++;
 
-    Triangle t = e->tri();
-    tris.push_back(t);
-    used.insert(e);
-    used.insert(e->prev());
-    used.insert(e->next());
-  }
+  double area = ((*p[1] - *p[0]) ^ (*p[2] - *p[0])).length() * 0.5;
+  double aspect = area > iMath::err ? maxLength*perimeter / (4.0*sqrt(3.0)*area) : DBL_MAX;
+
+  static const double aspectBounds[MeshQualityStats::AspectBins-1] = { 1.5, 2, 3, 5, 10 };
+  int bin = 0;
+  for ( ; bin < MeshQualityStats::AspectBins-1 && aspect >= aspectBounds[bin]; ++bin);
+  quality.aspect_[bin]++;
+
+  quality.triangles_++;
 }
 
 void DelaunayTriangulator::prebuild()
 {
+  STAGE_TIMER("prebuild");
+  TRACE_SCOPE("prebuild");
+
   OrEdge * curr = 0, * first = 0;
   for (size_t i = 0; i < container_.verts().size(); ++i)
   {
@@ -458,12 +1230,271 @@ void DelaunayTriangulator::prebuild()
   splitThreshold_ = edgeLength_*2.0;
   thinThreshold_  = edgeLength_*0.25;
 
-  intrusionPoint(curr);
+  if ( !planarBuild(curr) )
+  {
+    if ( pool_ )
+    {
+      size_t boundaryN = container_.edges().size();
+      TriangulationStats before = stats_;
+
+      stats_.prebuildTasks_++;
+      tasks_.push_back(PrebuildTask());
+      tasks_.back().index_.reset( new OcTree<OrEdge>(rect_, indexDepth) );
+      pool_->submit( boost::bind(&DelaunayTriangulator::intrusionPoint, this, curr, &tasks_.back()) );
+      pool_->run();
+      stats_.prebuildSteals_ = pool_->stealsCount();
+      for (size_t i = 0; i < queries_.size(); ++i)
+        queries_[i].task_ = 0;
+
+      // tasks didn't see each other's diagonals
+      if ( !commitDiagonals() )
+      {
+        undoDiagonals(boundaryN);
+        stats_.earsClipped_ = before.earsClipped_;
+        stats_.diagonalsAdded_ = before.diagonalsAdded_;
+        stats_.convexAltFallbacks_ = before.convexAltFallbacks_;
+        stats_.cutsRejected_ = before.cutsRejected_;
+        stats_.prebuildRedone_ = true;
+        intrusionPoint(container_.edges().back().get(), 0);
+      }
+      tasks_.clear();
+    }
+    else
+      intrusionPoint(curr, 0);
+
+    // creation order of diagonals depends on threads timing
+    if ( options_.stableOrder_ )
+      container_.sortEdges(boundary_.size());
+  }
+
+  stats_.planar_ = planar_;
+  stats_.projected_ = projected_;
+}
+
+bool DelaunayTriangulator::planarBuild(OrEdge * from)
+{
+  TRACE_SCOPE("planarBuild");
+
+  const Vertices & verts = container_.verts();
+
+  // flat boundary has its own plane, curved one is tried with averaged normal, then with area normal
+  iPlanar::PlaneFrame frames[2];
+  int framesN = 0;
+  bool flat = options_.planarFastPath_ && iPlanar::planarFrame(verts, 1e-9, frames[0]);
+  if ( flat )
+    framesN = 1;
+  else if ( options_.projectionMode_ )
+  {
+    if ( iPlanar::fitFrame(verts, frames[framesN]) )
+      framesN++;
+    if ( iPlanar::areaFrame(verts, frames[framesN]) )
+      framesN++;
+  }
+
+  Points3f poly(verts.size());
+  Triangles tris;
+  int found = -1;
+  for (int k = 0; k < framesN && found < 0; ++k)
+  {
+    for (size_t i = 0; i < verts.size(); ++i)
+    {
+      poly[i] = frames[k].project(verts[i].p());
+      poly[i].z = 0;
+    }
+
+    // boundary is expected counter-clockwise looking against normal, mirror otherwise
+    if ( iPlanar::signedArea(poly) < 0 )
+    {
+      for (size_t i = 0; i < poly.size(); ++i)
+        poly[i].y = -poly[i].y;
+    }
+
+    if ( iPlanar::isSimple(poly) && iPlanar::triangulate(poly, tris) )
+      found = k;
+  }
+
+  if ( found < 0 )
+    return false;
+
+  // directed edges by their ends, boundary ones first
+  typedef std::map<std::pair<int, int>, OrEdge*> EdgesMap;
+  EdgesMap edges;
+  OrEdge * e = from;
+  do
+  {
+    edges[std::make_pair(e->org(), e->dst())] = e;
+    e = e->next();
+  } while ( e != from );
+
+  for (Triangles::const_iterator i = tris.begin(); i != tris.end(); ++i)
+  {
+    OrEdge * te[3];
+    for (int j = 0; j < 3; ++j)
+    {
+      int o = i->v[j], d = i->v[(j+1) % 3];
+      EdgesMap::iterator found = edges.find(std::make_pair(o, d));
+      if ( found != edges.end() )
+      {
+        te[j] = found->second;
+        continue;
+      }
+
+      EdgesMap::iterator rev = edges.find(std::make_pair(d, o));
+      if ( rev != edges.end() )
+        te[j] = rev->second->create_adjacent();
+      else
+      {
+        te[j] = container_.new_edge(o, d);
+        stats_.planarDiagonals_++;
+      }
+      edges[std::make_pair(o, d)] = te[j];
+    }
+
+    for (int j = 0; j < 3; ++j)
+      te[j]->set_next(te[(j+1) % 3]);
+  }
+
+  planar_ = flat;
+  projected_ = !flat;
+  if ( projected_ )
+    plane_.swap(poly);
+
+  return true;
+}
+
+bool DelaunayTriangulator::foldsProjection(const OrEdge * edge) const
+{
+  const OrEdge * adj = edge->get_adjacent();
+
+  // all of them are boundary points, split wasn't done yet
+  const Vec3f & po = plane_.at(edge->org());
+  const Vec3f & pd = plane_.at(edge->dst());
+  const Vec3f & pr = plane_.at(edge->next()->dst());
+  const Vec3f & pl = plane_.at(adj->next()->dst());
+
+  return iPlanar::orient(pr, pl, pd) <= 0 || iPlanar::orient(pl, pr, po) <= 0;
+}
+
+namespace
+{
+  struct Diagonal
+  {
+    Diagonal(OrEdge * e) : e_(e) {}
+
+    OrEdge * e_;
+
+    bool operator < (const Diagonal & other) const
+    {
+      if ( e_->org() != other.e_->org() )
+        return e_->org() < other.e_->org();
+      return e_->dst() < other.e_->dst();
+    }
+  };
+}
+
+bool DelaunayTriangulator::commitDiagonals()
+{
+  std::vector<Diagonal> diagonals;
+  EdgesSet_const made;
+  for (size_t k = 0; k < tasks_.size(); ++k)
+  {
+    for (size_t i = 0; i < tasks_[k].diagonals_.size(); ++i)
+    {
+      OrEdge * e = tasks_[k].diagonals_[i];
+      diagonals.push_back( Diagonal(e) );
+      made.insert(e);
+      made.insert(e->get_adjacent());
+    }
+  }
+
+  // tasks order depends on threads timing
+  std::sort(diagonals.begin(), diagonals.end());
+
+  for (size_t i = 0; i < diagonals.size(); ++i)
+  {
+    octree_->add(diagonals[i].e_);
+    octree_->add(diagonals[i].e_->get_adjacent());
+  }
+
+  // the only task saw all diagonals, as it does on one thread
+  if ( tasks_.size() == 1 )
+    return true;
+
+  for (size_t i = 0; i < diagonals.size(); ++i)
+  {
+    const OrEdge * e = diagonals[i].e_;
+    EdgesSet_const items;
+    octree_->find(e->rect(), items);
+
+    const Vec3f & p0 = container_.verts().at(e->org()).p();
+    const Vec3f & p1 = container_.verts().at(e->dst()).p();
+
+    for (EdgesSet_const::const_iterator j = items.begin(); j != items.end(); ++j)
+    {
+      const OrEdge * f = *j;
+      // diagonals of the same task too, they may cross because of something the task didn't see
+      if ( made.find(f) == made.end() )
+        continue;
+
+      if ( f->org() == e->org() || f->org() == e->dst() || f->dst() == e->org() || f->dst() == e->dst() )
+        continue;
+
+      const Vec3f & q0 = container_.verts().at(f->org()).p();
+      const Vec3f & q1 = container_.verts().at(f->dst()).p();
+
+      Vec3f r;
+      double dist = 0;
+      if ( iMath::edges_isect(p0, p1, q0, q1, r, dist) && fabs(dist) < rotateThreshold_ )
+        return false;
+    }
+  }
+
+  return true;
+}
+
+void DelaunayTriangulator::undoDiagonals(size_t n)
+{
+  for (size_t k = 0; k < tasks_.size(); ++k)
+  {
+    for (size_t i = 0; i < tasks_[k].diagonals_.size(); ++i)
+    {
+      OrEdge * e = tasks_[k].diagonals_[i];
+      octree_->remove(e);
+      octree_->remove(e->get_adjacent());
+    }
+  }
+
+  OrEdgesList_shared & edges = container_.edges();
+  OrEdgesList_shared::iterator i = edges.begin();
+  for (size_t j = 0; j < n; ++j, ++i)
+  {
+    OrEdgesList_shared::iterator next = i;
+    ++next;
+    (*i)->set_next( j+1 < n ? next->get() : edges.front().get() );
+  }
+  edges.erase(i, edges.end());
+}
+
+void DelaunayTriangulator::addDiagonal(OrEdge * e, PrebuildTask * task)
+{
+  if ( task )
+  {
+    task->diagonals_.push_back(e);
+    task->visible_.push_back(e);
+    task->index_->add(e);
+    task->index_->add(e->get_adjacent());
+    return;
+  }
+
+  octree_->add(e);
+  octree_->add(e->get_adjacent());
 }
 
 //////////////////////////////////////////////////////////////////////////
-void DelaunayTriangulator::intrusionPoint(OrEdge * from)
+void DelaunayTriangulator::intrusionPoint(OrEdge * from, PrebuildTask * task)
 {
+  workerQueries().task_ = task;
+
   EdgesList elist;
   elist.push_back(from);
 
@@ -491,6 +1522,21 @@ void DelaunayTriangulator::intrusionPoint(OrEdge * from)
     }
 
     OrEdge * ir_edge = findIntrudeEdge(cv_edge);
+
+    // cut leaving triangles that cross the mesh or have no area is left for the next best one.
+    // small polygon is triangulated at once, if there is a way without such triangles
+    if ( !isCutValid(cv_edge, ir_edge) )
+    {
+      bool done = triangulateSmall(curr, task);
+      if ( done || findValidCut(curr, cv_edge, cv_prev, ir_edge) )
+      {
+        boost::mutex::scoped_lock lock(buildMutex_);
+        stats_.cutsRejected_++;
+      }
+      if ( done )
+        continue;
+    }
+
     if ( ir_edge )
     {
       OrEdge * cv_next = cv_edge->next();
@@ -498,55 +1544,345 @@ void DelaunayTriangulator::intrusionPoint(OrEdge * from)
       if ( !cv_next || !ir_next )
         return;
 
-      OrEdge * e = container_.new_edge(ir_edge->dst(), cv_edge->dst());
-      OrEdge * a = e->create_adjacent();
+      OrEdge * e = 0, * a = 0;
+      {
+        boost::mutex::scoped_lock lock(buildMutex_);
+        e = container_.new_edge(ir_edge->dst(), cv_edge->dst());
+        a = e->create_adjacent();
+        stats_.diagonalsAdded_++;
+      }
+      addDiagonal(e, task);
+
+      e->set_next(cv_next);
+      ir_edge->set_next(e);
+
+      cv_edge->set_next(a);
+      a->set_next(ir_next);
+
+      elist.push_back(e);
+
+      // the other part never touches this one again
+      if ( task )
+      {
+        PrebuildTask * other = 0;
+        {
+          boost::mutex::scoped_lock lock(buildMutex_);
+          stats_.prebuildTasks_++;
+          tasks_.push_back(PrebuildTask());
+          other = &tasks_.back();
+        }
+
+        other->visible_ = task->visible_;
+        other->index_.reset( new OcTree<OrEdge>(rect_, indexDepth) );
+        for (size_t i = 0; i < other->visible_.size(); ++i)
+        {
+          other->index_->add(other->visible_[i]);
+          other->index_->add(other->visible_[i]->get_adjacent());
+        }
+        pool_->submit( boost::bind(&DelaunayTriangulator::intrusionPoint, this, a, other) );
+      }
+      else
+        elist.push_back(a);
+    }
+    else
+    {
+      OrEdge * cv_next = cv_edge->next();
+      if ( !cv_next )
+         throw std::runtime_error("wrong topology given");;
+
+      
+      //Triangle tr(cv_edge->org(), cv_edge->dst(), cv_next->dst());
+      //bool found = selfIsect(tr);
+      //if ( found )
+      //{
+      //  save3d("D:\\Scenes\\3dpad\\tri_isect2.txt", "Mesh", "Boundary");
+      //  findIntrudeEdge(cv_edge);
+      //}
+
+      OrEdge * e = clipEar(cv_prev, cv_edge, task);
+
+      //if ( found )
+      //{
+      //  save3d("D:\\Scenes\\3dpad\\tri_isect2.txt", "Mesh", "Boundary");
+      //}
+      elist.push_back(e);
+    }
+  }
+}
+
+namespace
+{
+  // ear at edge->dst() tried by findValidCut. convex ones go first, then shorter ones, then in polygon order
+  struct EarCandidate
+  {
+    bool convex_;
+    double length_;
+    size_t order_;
+    OrEdge * edge_, * prev_;
+
+    bool operator < (const EarCandidate & other) const
+    {
+      if ( convex_ != other.convex_ )
+        return convex_;
+      if ( length_ != other.length_ )
+        return length_ < other.length_;
+      return order_ < other.order_;
+    }
+  };
+}
+
+bool DelaunayTriangulator::hasArea(const Triangle & tr) const
+{
+  const Vec3f & p0 = container_.verts().at(tr.x).p();
+  const Vec3f & p1 = container_.verts().at(tr.y).p();
+  const Vec3f & p2 = container_.verts().at(tr.z).p();
+  return ((p1 - p0) ^ (p2 - p0)).length() >= iMath::err;
+}
+
+bool DelaunayTriangulator::isTriangleValid(const Triangle & tr) const
+{
+  const Vec3f & p0 = container_.verts().at(tr.x).p();
+  const Vec3f & p1 = container_.verts().at(tr.y).p();
+  const Vec3f & p2 = container_.verts().at(tr.z).p();
+  // triangle on coincident points has no area anyway, it's cut while it is small
+  bool coincident = (p1 - p0).length() < iMath::err || (p2 - p1).length() < iMath::err || (p0 - p2).length() < iMath::err;
+  if ( !coincident && !hasArea(tr) )
+    return false;
+
+  return !selfIsect(tr);
+}
+
+bool DelaunayTriangulator::isCutValid(const OrEdge * cv_edge, const OrEdge * ir_edge) const
+{
+  const OrEdge * cv_next = cv_edge->next();
+
+  if ( !ir_edge )
+  {
+    if ( !isTriangleValid(Triangle(cv_edge->org(), cv_edge->dst(), cv_next->dst())) )
+      return false;
+
+    // the rest of 4 edges is a triangle too
+    const OrEdge * last = cv_next->next();
+    return last->next()->next() != cv_edge || isTriangleValid(Triangle(last->org(), last->dst(), cv_edge->org()));
+  }
+
+  // parts on either side of the diagonal made of 3 edges are triangles already
+  if ( cv_next->next() == ir_edge && !isTriangleValid(Triangle(cv_edge->dst(), cv_next->dst(), ir_edge->dst())) )
+    return false;
+
+  const OrEdge * ir_next = ir_edge->next();
+  return ir_next->next() != cv_edge || isTriangleValid(Triangle(ir_edge->dst(), ir_next->dst(), cv_edge->dst()));
+}
+
+bool DelaunayTriangulator::findValidCut(OrEdge * from, OrEdge *& cv_edge, OrEdge *& cv_prev, OrEdge *& ir_edge)
+{
+  STAGE_TIMER("findValidCut");
+
+  std::vector<EarCandidate> ears;
+  OrEdge * prev = 0;
+  size_t order = 0;
+  for ( OrEdge * curr = from;; ++order )
+  {
+    OrEdge * next = curr->next();
+
+    THROW_IF( !next, "bad topology" );
+
+    if ( curr != cv_edge )
+    {
+      EarCandidate ear;
+      ear.convex_ = isEdgeConvex(curr);
+      ear.length_ = (container_.verts().at(next->dst()).p() - container_.verts().at(curr->org()).p()).length();
+      ear.order_ = order;
+      ear.edge_ = curr;
+      ear.prev_ = prev;
+      ears.push_back(ear);
+    }
+
+    prev = curr;
+    curr = next;
+
+    if ( curr == from )
+      break;
+  }
+
+  std::sort(ears.begin(), ears.end());
+  for (size_t i = 0; i < ears.size(); ++i)
+  {
+    OrEdge * ir = findIntrudeEdge(ears[i].edge_);
+    if ( !isCutValid(ears[i].edge_, ir) )
+      continue;
+
+    cv_edge = ears[i].edge_;
+    cv_prev = ears[i].prev_ ? ears[i].prev_ : cv_edge->prev();
+    ir_edge = ir;
+    return true;
+  }
+
+  return false;
+}
+
+OrEdge * DelaunayTriangulator::clipEar(OrEdge * cv_prev, OrEdge * cv_edge, PrebuildTask * task)
+{
+  OrEdge * cv_next = cv_edge->next();
+
+  OrEdge * e = 0, * a = 0;
+  {
+    boost::mutex::scoped_lock lock(buildMutex_);
+    e = container_.new_edge(cv_edge->org(), cv_next->dst());
+    a = e->create_adjacent();
+    stats_.earsClipped_++;
+  }
+  addDiagonal(e, task);
+
+  cv_prev->set_next(e);
+  e->set_next(cv_next->next());
+
+  cv_next->set_next(a);
+  a->set_next(cv_edge);
+
+  return e;
+}
+
+namespace
+{
+  // triangles without common vertices cross each other
+  bool trianglesCross(const Vertices & verts, const Triangle & t, const Triangle & s)
+  {
+    for (int i = 0; i < 3; ++i)
+    {
+      if ( t.v[i] == s.x || t.v[i] == s.y || t.v[i] == s.z )
+        return false;
+    }
+
+    for (int k = 0; k < 2; ++k)
+    {
+      const Triangle & a = k ? s : t;
+      const Triangle & b = k ? t : s;
+      for (int i = 0; i < 3; ++i)
+      {
+        Vec3f ip;
+        if ( iMath::edge_tri_isect(verts.at(a.v[i]).p(), verts.at(a.v[(i+1)%3]).p(),
+                                   verts.at(b.x).p(), verts.at(b.y).p(), verts.at(b.z).p(), ip) )
+        {
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+}
+
+bool DelaunayTriangulator::TriangleLess::operator () (const Triangle & a, const Triangle & b) const
+{
+  int u[3] = { a.x, a.y, a.z }, w[3] = { b.x, b.y, b.z };
+  std::sort(u, u+3);
+  std::sort(w, w+3);
+  return std::lexicographical_compare(u, u+3, w, w+3);
+}
+
+bool DelaunayTriangulator::triangulateSmall(OrEdge * from, PrebuildTask * task)
+{
+  STAGE_TIMER("triangulateSmall");
+
+  const size_t smallN = 8;
+
+  // poly[i] goes from pts[i] to pts[i+1]
+  std::vector<OrEdge*> poly;
+  std::vector<int> pts;
+  for ( OrEdge * curr = from; poly.size() <= smallN; )
+  {
+    poly.push_back(curr);
+    pts.push_back(curr->org());
+    curr = curr->next();
+    if ( curr == from )
+      break;
+  }
+
+  if ( poly.size() < 4 || poly.size() > smallN )
+    return false;
+
+  std::vector<int> rest(pts), order;
+  std::vector<Triangle> tris;
+  std::map<Triangle, bool, TriangleLess> valid;
+  if ( !searchEars(rest, tris, order, valid) )
+    return false;
+
+  for (size_t i = 0; i < order.size(); ++i)
+  {
+    size_t j = std::find(pts.begin(), pts.end(), order[i]) - pts.begin();
+    size_t n = pts.size();
+    OrEdge * cv_prev = poly[(j + n - 2) % n];
+    OrEdge * cv_edge = poly[(j + n - 1) % n];
+
+    OrEdge * e = clipEar(cv_prev, cv_edge, task);
 
-      octree_->add(e);
-      octree_->add(a);
+    // the ear's edges are replaced by its diagonal
+    poly[(j + n - 1) % n] = e;
+    poly.erase(poly.begin() + j);
+    pts.erase(pts.begin() + j);
+  }
 
-      e->set_next(cv_next);
-      ir_edge->set_next(e);
+  return true;
+}
 
-      cv_edge->set_next(a);
-      a->set_next(ir_next);
+bool DelaunayTriangulator::searchEars(std::vector<int> & pts, std::vector<Triangle> & tris, std::vector<int> & order,
+                                      std::map<Triangle, bool, TriangleLess> & valid) const
+{
+  size_t n = pts.size();
 
-      elist.push_back(e);
-      elist.push_back(a);
-    }
-    else
-    {
-      OrEdge * cv_next = cv_edge->next();
-      if ( !cv_next )
-         throw std::runtime_error("wrong topology given");;
+  // convex ears go first, then shorter ones
+  std::vector<EarCandidate> ears;
+  for (size_t j = 0; j < n; ++j)
+  {
+    int pre = pts[(j + n - 1) % n], cur = pts[j], nxt = pts[(j + 1) % n];
 
-      
-      //Triangle tr(cv_edge->org(), cv_edge->dst(), cv_next->dst());
-      //bool found = selfIsect(tr);
-      //if ( found )
-      //{
-      //  save3d("D:\\Scenes\\3dpad\\tri_isect2.txt", "Mesh", "Boundary");
-      //  findIntrudeEdge(cv_edge);
-      //}
+    EarCandidate ear;
+    ear.convex_ = n == 3 || isConvex(pre, cur, nxt);
+    ear.length_ = (container_.verts().at(nxt).p() - container_.verts().at(pre).p()).length();
+    ear.order_ = j;
+    ear.edge_ = ear.prev_ = 0;
+    ears.push_back(ear);
 
-      OrEdge * e = container_.new_edge(cv_edge->org(), cv_next->dst());
-      OrEdge * a = e->create_adjacent();
+    // last triangle has only one way
+    if ( n == 3 )
+      break;
+  }
+  std::sort(ears.begin(), ears.end());
 
-      octree_->add(e);
-      octree_->add(a);
+  for (size_t i = 0; i < ears.size(); ++i)
+  {
+    size_t j = ears[i].order_;
+    Triangle tr(pts[(j + n - 1) % n], pts[j], pts[(j + 1) % n]);
 
-      cv_prev->set_next(e);
-      e->set_next(cv_next->next());
+    std::map<Triangle, bool, TriangleLess>::iterator v = valid.find(tr);
+    if ( v == valid.end() )
+      v = valid.insert(std::make_pair(tr, isTriangleValid(tr))).first;
+    if ( !v->second )
+      continue;
 
-      cv_next->set_next(a);
-      a->set_next(cv_edge);
+    bool crosses = false;
+    for (size_t k = 0; k < tris.size() && !crosses; ++k)
+      crosses = trianglesCross(container_.verts(), tr, tris[k]);
+    if ( crosses )
+      continue;
 
-      //if ( found )
-      //{
-      //  save3d("D:\\Scenes\\3dpad\\tri_isect2.txt", "Mesh", "Boundary");
-      //}
-      elist.push_back(e);
-    }
+    if ( n == 3 )
+      return true;
+
+    int apex = pts[j];
+    tris.push_back(tr);
+    order.push_back(apex);
+    pts.erase(pts.begin() + j);
+
+    if ( searchEars(pts, tris, order, valid) )
+      return true;
+
+    pts.insert(pts.begin() + j, apex);
+    order.pop_back();
+    tris.pop_back();
   }
+
+  return false;
 }
 
 bool DelaunayTriangulator::isEdgeConvex(const OrEdge * edge) const
@@ -554,9 +1890,14 @@ bool DelaunayTriangulator::isEdgeConvex(const OrEdge * edge) const
   if ( !edge )
     return false;
 
-  const Vertex & pre = container_.verts().at( edge->org() );
-  const Vertex & cur = container_.verts().at( edge->dst() );
-  const Vertex & nxt = container_.verts().at( edge->next()->dst() );
+  return isConvex(edge->org(), edge->dst(), edge->next()->dst());
+}
+
+bool DelaunayTriangulator::isConvex(int v0, int v1, int v2) const
+{
+  const Vertex & pre = container_.verts().at( v0 );
+  const Vertex & cur = container_.verts().at( v1 );
+  const Vertex & nxt = container_.verts().at( v2 );
 
   Vec3f dir = (pre.p() - cur.p()) ^ (nxt.p() - cur.p());
   if ( dir.length() < err )
@@ -570,6 +1911,8 @@ bool DelaunayTriangulator::isEdgeConvex(const OrEdge * edge) const
 
 OrEdge * DelaunayTriangulator::findConvexEdge(OrEdge * from, OrEdge *& cv_prev)
 {
+  STAGE_TIMER("findConvexEdge");
+
   if ( !from )
     return 0;
 
@@ -609,7 +1952,13 @@ OrEdge * DelaunayTriangulator::findConvexEdge(OrEdge * from, OrEdge *& cv_prev)
   }
 
   if ( !best )
+  {
+    {
+      boost::mutex::scoped_lock lock(buildMutex_);
+      stats_.convexAltFallbacks_++;
+    }
     best = findConvexEdgeAlt(from, cv_prev);
+  }
 
   if ( !cv_prev )
     cv_prev = best->prev();
@@ -780,6 +2129,8 @@ void DelaunayTriangulator::writeSomething(const char * fname, const Vec3f & p0,
 
 OrEdge * DelaunayTriangulator::findIntrudeEdge(OrEdge * cv_edge)
 {
+  STAGE_TIMER("findIntrudeEdge");
+
   if ( !cv_edge )
     return 0;
 
@@ -848,6 +2199,17 @@ OrEdge * DelaunayTriangulator::findIntrudeEdge(OrEdge * cv_edge)
 
 void DelaunayTriangulator::smooth(int itersN)
 {
+  STAGE_TIMER("smooth");
+  TRACE_SCOPE("smooth");
+
+  if ( options_.vertexSmoothing_ )
+  {
+    smoothVertices(itersN);
+    return;
+  }
+
+  stats_.smoothIterations_ += itersN;
+
   for (int n = 0; n < itersN; ++n)
   for (OrEdgesList_shared::iterator i = container_.edges().begin(); i != container_.edges().end(); ++i)
   {
@@ -856,6 +2218,515 @@ void DelaunayTriangulator::smooth(int itersN)
   }
 }
 
+namespace
+{
+  // smoothing state as separate coordinate arrays. positions and vertex normals are double buffered:
+  // an iteration reads buffer 0 and writes buffer 1, then copies moved vertices back,
+  // so chunks of vertices are independent
+  struct SmoothMesh
+  {
+    std::vector<double> x_[2], y_[2], z_[2];
+    std::vector<double> nx_[2], ny_[2], nz_[2];
+
+    // faces and their unit normals
+    std::vector<int> a_, b_, c_;
+    std::vector<double> fx_, fy_, fz_;
+
+    // one-ring of movable_[i] is [ringStart_[i], ringStart_[i+1]), fan_[j] is face between ring_[j] and the next one.
+    // slot_[v] is index of v in movable_, -1 if v is fixed
+    std::vector<int> movable_, slot_, ringStart_, ring_, fan_;
+
+    // faces around vertex v are vertFaces_[j], j in [faceStart_[v], faceStart_[v+1])
+    std::vector<int> faceStart_, vertFaces_;
+
+    // indices in movable_ to process and faces around them, squared displacements of active_[i]
+    std::vector<int> active_, faces_;
+    std::vector<double> shift_;
+
+    void faceNormals(size_t begin, size_t end)
+    {
+      const double * x = &x_[0][0], * y = &y_[0][0], * z = &z_[0][0];
+      for (size_t i = begin; i < end; ++i)
+      {
+        int f = faces_[i];
+        double ux = x[b_[f]] - x[a_[f]], uy = y[b_[f]] - y[a_[f]], uz = z[b_[f]] - z[a_[f]];
+        double vx = x[c_[f]] - x[a_[f]], vy = y[c_[f]] - y[a_[f]], vz = z[c_[f]] - z[a_[f]];
+        double nx = uy*vz - uz*vy, ny = uz*vx - ux*vz, nz = ux*vy - uy*vx;
+        double len = sqrt(nx*nx + ny*ny + nz*nz);
+        double s = len > 0 ? 1.0/len : 0.0;
+        fx_[f] = nx*s;
+        fy_[f] = ny*s;
+        fz_[f] = nz*s;
+      }
+    }
+
+    void relax(size_t begin, size_t end)
+    {
+      const double * x = &x_[0][0], * y = &y_[0][0], * z = &z_[0][0];
+      const double * nx = &nx_[0][0], * ny = &ny_[0][0], * nz = &nz_[0][0];
+      for (size_t i = begin; i < end; ++i)
+      {
+        int v = movable_[active_[i]];
+        int first = ringStart_[active_[i]], last = ringStart_[active_[i]+1];
+
+        double px = 0, py = 0, pz = 0;
+        double qx = nx[v], qy = ny[v], qz = nz[v];
+        double mx = 0, my = 0, mz = 0;
+        for (int j = first; j < last; ++j)
+        {
+          int r = ring_[j], f = fan_[j];
+          px += x[r]; py += y[r]; pz += z[r];
+          qx += nx[r]; qy += ny[r]; qz += nz[r];
+          mx += fx_[f]; my += fy_[f]; mz += fz_[f];
+        }
+
+        // the widest angle between fan faces is about twice the widest one to their mean normal
+        double cosaMean = -1.0;
+        double mlen = sqrt(mx*mx + my*my + mz*mz);
+        if ( mlen > 0 )
+        {
+          cosaMean = 1.0;
+          for (int j = first; j < last; ++j)
+          {
+            int f = fan_[j];
+            cosaMean = std::min(cosaMean, (fx_[f]*mx + fy_[f]*my + fz_[f]*mz) / mlen);
+          }
+        }
+        double cosaMin = cosaMean < 0 ? -1.0 : 2.0*cosaMean*cosaMean - 1.0;
+
+        double coef = std::max(0.0, std::min(1.0, (1.0 - cosaMin)*0.5));
+
+        // one step for each edge around, as if the vertex was moved from every one of them
+        coef = 1.0 - pow(1.0 - coef, last - first);
+
+        double k = 1.0 / (last - first);
+        double dx = (px*k - x[v])*coef, dy = (py*k - y[v])*coef, dz = (pz*k - z[v])*coef;
+
+        // the step is halved while it turns some face of the fan over or collapses it, then dropped
+        int halvings = 0;
+        for ( ; halvings < 4 && !keepsFan(v, first, last, x[v] + dx, y[v] + dy, z[v] + dz, mx, my, mz); ++halvings)
+        {
+          dx *= 0.5; dy *= 0.5; dz *= 0.5;
+        }
+        if ( halvings == 4 )
+          dx = dy = dz = 0;
+
+        x_[1][v] = x[v] + dx;
+        y_[1][v] = y[v] + dy;
+        z_[1][v] = z[v] + dz;
+        shift_[i] = dx*dx + dy*dy + dz*dz;
+
+        double qlen = sqrt(qx*qx + qy*qy + qz*qz);
+        double s = qlen > 0 ? 1.0/qlen : 0.0;
+        nx_[1][v] = qx*s;
+        ny_[1][v] = qy*s;
+        nz_[1][v] = qz*s;
+      }
+    }
+
+    // faces of the fan around v with v at (px, py, pz) aren't turned over against their mean normal m,
+    // keep more than minArea of their area and don't cross faces around the one-ring they didn't cross before.
+    // faces folded or crossing already don't stop the vertex
+    bool keepsFan(int v, int first, int last, double px, double py, double pz, double mx, double my, double mz) const
+    {
+      const double minArea = 0.01;
+      const double * x = &x_[0][0], * y = &y_[0][0], * z = &z_[0][0];
+      for (int j = first; j < last; ++j)
+      {
+        int f = fan_[j];
+        int u[3] = { a_[f], b_[f], c_[f] };
+        double qx[3], qy[3], qz[3];
+        for (int k = 0; k < 3; ++k)
+        {
+          qx[k] = u[k] == v ? px : x[u[k]];
+          qy[k] = u[k] == v ? py : y[u[k]];
+          qz[k] = u[k] == v ? pz : z[u[k]];
+        }
+
+        double ux = qx[1] - qx[0], uy = qy[1] - qy[0], uz = qz[1] - qz[0];
+        double wx = qx[2] - qx[0], wy = qy[2] - qy[0], wz = qz[2] - qz[0];
+        double nx = uy*wz - uz*wy, ny = uz*wx - ux*wz, nz = ux*wy - uy*wx;
+
+        ux = x[u[1]] - x[u[0]]; uy = y[u[1]] - y[u[0]]; uz = z[u[1]] - z[u[0]];
+        wx = x[u[2]] - x[u[0]]; wy = y[u[2]] - y[u[0]]; wz = z[u[2]] - z[u[0]];
+        double ox = uy*wz - uz*wy, oy = uz*wx - ux*wz, oz = ux*wy - uy*wx;
+        if ( ox*mx + oy*my + oz*mz > 0 && nx*mx + ny*my + nz*mz <= 0 )
+          return false;
+
+        if ( nx*nx + ny*ny + nz*nz <= minArea*minArea*(ox*ox + oy*oy + oz*oz) )
+          return false;
+
+        for (int i = first; i < last; ++i)
+        {
+          for (int k = faceStart_[ring_[i]]; k < faceStart_[ring_[i]+1]; ++k)
+          {
+            int g = vertFaces_[k];
+            if ( a_[g] == u[0] || a_[g] == u[1] || a_[g] == u[2] ||
+                 b_[g] == u[0] || b_[g] == u[1] || b_[g] == u[2] ||
+                 c_[g] == u[0] || c_[g] == u[1] || c_[g] == u[2] )
+            {
+              continue;
+            }
+
+            if ( crosses(f, g, v, px, py, pz) && !crosses(f, g, v, x[v], y[v], z[v]) )
+              return false;
+          }
+        }
+      }
+      return true;
+    }
+
+    // face f with v at (px, py, pz) crosses face g, they have no common vertices
+    bool crosses(int f, int g, int v, double px, double py, double pz) const
+    {
+      const double * x = &x_[0][0], * y = &y_[0][0], * z = &z_[0][0];
+      int fu[3] = { a_[f], b_[f], c_[f] }, gu[3] = { a_[g], b_[g], c_[g] };
+      Vec3f p[3], q[3];
+      for (int k = 0; k < 3; ++k)
+      {
+        p[k] = fu[k] == v ? Vec3f(px, py, pz) : Vec3f(x[fu[k]], y[fu[k]], z[fu[k]]);
+        q[k] = Vec3f(x[gu[k]], y[gu[k]], z[gu[k]]);
+      }
+
+      Rect3f rf, rg;
+      for (int k = 0; k < 3; ++k)
+      {
+        rf.add(p[k]);
+        rg.add(q[k]);
+      }
+      if ( !rf.intersecting(rg) )
+        return false;
+
+      Vec3f ip;
+      for (int k = 0; k < 3; ++k)
+      {
+        if ( iMath::edge_tri_isect(p[k], p[(k+1)%3], q[0], q[1], q[2], ip) ||
+             iMath::edge_tri_isect(q[k], q[(k+1)%3], p[0], p[1], p[2], ip) )
+        {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    void store(size_t begin, size_t end)
+    {
+      for (size_t i = begin; i < end; ++i)
+      {
+        int v = movable_[active_[i]];
+        x_[0][v] = x_[1][v];   y_[0][v] = y_[1][v];   z_[0][v] = z_[1][v];
+        nx_[0][v] = nx_[1][v]; ny_[0][v] = ny_[1][v]; nz_[0][v] = nz_[1][v];
+      }
+    }
+  };
+}
+
+/**
+  Inner vertices are moved towards centroids of their one-rings, the more the fan around is bent, the further.
+  New positions are computed from the old ones, so neither the order of vertices nor the number of threads matters.
+  After the first iteration only vertices moved by more than smoothTolerance_ and their neighbours are processed,
+  smoothing stops when there are none or after itersN iterations. Boundary stays in place.
+  Steps that turn a face of the fan against the fan's mean normal, collapse it or make it cross a face
+  around the one-ring are shortened, then dropped
+*/
+void DelaunayTriangulator::smoothVertices(int itersN)
+{
+  Vertices & verts = container_.verts();
+  const OrEdgesList_shared & edges = container_.edges();
+
+  SmoothMesh mesh;
+
+  // faces are numbered by their edges, ids of edges are sequential
+  std::vector<int> faceOf(edges.size(), -1);
+  std::vector<OrEdge*> out(verts.size(), (OrEdge*)0);
+  for (OrEdgesList_shared::const_iterator i = edges.begin(); i != edges.end(); ++i)
+  {
+    OrEdge * e = i->get();
+    out[e->org()] = e;
+
+    if ( faceOf[e->id()] >= 0 || e->next()->next()->next() != e )
+      continue;
+
+    faceOf[e->id()] = faceOf[e->next()->id()] = faceOf[e->next()->next()->id()] = (int)mesh.a_.size();
+    Triangle tr = e->tri();
+    mesh.a_.push_back(tr.x);
+    mesh.b_.push_back(tr.y);
+    mesh.c_.push_back(tr.z);
+  }
+
+  mesh.faceStart_.assign(verts.size() + 1, 0);
+  for (size_t f = 0; f < mesh.a_.size(); ++f)
+  {
+    mesh.faceStart_[mesh.a_[f] + 1]++;
+    mesh.faceStart_[mesh.b_[f] + 1]++;
+    mesh.faceStart_[mesh.c_[f] + 1]++;
+  }
+  for (size_t v = 0; v < verts.size(); ++v)
+    mesh.faceStart_[v+1] += mesh.faceStart_[v];
+
+  std::vector<int> filled(mesh.faceStart_.begin(), mesh.faceStart_.end() - 1);
+  mesh.vertFaces_.resize(mesh.a_.size()*3);
+  for (size_t f = 0; f < mesh.a_.size(); ++f)
+  {
+    mesh.vertFaces_[filled[mesh.a_[f]]++] = (int)f;
+    mesh.vertFaces_[filled[mesh.b_[f]]++] = (int)f;
+    mesh.vertFaces_[filled[mesh.c_[f]]++] = (int)f;
+  }
+
+  // one-rings of inner vertices closed around by faces
+  mesh.slot_.assign(verts.size(), -1);
+  for (size_t v = boundary_.size(); v < verts.size(); ++v)
+  {
+    if ( !out[v] )
+      continue;
+
+    size_t first = mesh.ring_.size();
+    OrEdge * curr = out[v];
+    do
+    {
+      if ( faceOf[curr->id()] < 0 )
+        break;
+
+      mesh.ring_.push_back(curr->dst());
+      mesh.fan_.push_back(faceOf[curr->id()]);
+      curr = curr->next()->next()->get_adjacent();
+    } while ( curr && curr != out[v] );
+
+    if ( curr != out[v] || mesh.ring_.size() == first )
+    {
+      mesh.ring_.resize(first);
+      mesh.fan_.resize(first);
+      continue;
+    }
+
+    mesh.slot_[v] = (int)mesh.movable_.size();
+    mesh.ringStart_.push_back((int)first);
+    mesh.movable_.push_back((int)v);
+  }
+  mesh.ringStart_.push_back((int)mesh.ring_.size());
+
+  if ( mesh.movable_.empty() )
+    return;
+
+  // vertices that don't move are the same in both buffers
+  for (int k = 0; k < 2; ++k)
+  {
+    mesh.x_[k].resize(verts.size());  mesh.y_[k].resize(verts.size());  mesh.z_[k].resize(verts.size());
+    mesh.nx_[k].resize(verts.size()); mesh.ny_[k].resize(verts.size()); mesh.nz_[k].resize(verts.size());
+    for (size_t v = 0; v < verts.size(); ++v)
+    {
+      mesh.x_[k][v] = verts[v].p().x;  mesh.y_[k][v] = verts[v].p().y;  mesh.z_[k][v] = verts[v].p().z;
+      mesh.nx_[k][v] = verts[v].n().x; mesh.ny_[k][v] = verts[v].n().y; mesh.nz_[k][v] = verts[v].n().z;
+    }
+  }
+  mesh.fx_.resize(mesh.a_.size());
+  mesh.fy_.resize(mesh.a_.size());
+  mesh.fz_.resize(mesh.a_.size());
+
+  for (size_t i = 0; i < mesh.movable_.size(); ++i)
+    mesh.active_.push_back((int)i);
+
+  double tolerance = options_.smoothTolerance_ * edgeLength_;
+  std::vector<int> faceMark(mesh.a_.size(), -1), slotMark(mesh.movable_.size(), -1);
+  for (int n = 0; n < itersN && !mesh.active_.empty(); ++n)
+  {
+    mesh.faces_.clear();
+    for (size_t i = 0; i < mesh.active_.size(); ++i)
+    {
+      for (int j = mesh.ringStart_[mesh.active_[i]]; j < mesh.ringStart_[mesh.active_[i]+1]; ++j)
+      {
+        int f = mesh.fan_[j];
+        if ( faceMark[f] == n )
+          continue;
+
+        faceMark[f] = n;
+        mesh.faces_.push_back(f);
+      }
+    }
+
+    mesh.shift_.resize(mesh.active_.size());
+    forEach(mesh.faces_.size(), boost::bind(&SmoothMesh::faceNormals, &mesh, boost::placeholders::_1, boost::placeholders::_2));
+    forEach(mesh.active_.size(), boost::bind(&SmoothMesh::relax, &mesh, boost::placeholders::_1, boost::placeholders::_2));
+    forEach(mesh.active_.size(), boost::bind(&SmoothMesh::store, &mesh, boost::placeholders::_1, boost::placeholders::_2));
+
+    stats_.smoothIterations_++;
+    stats_.smoothMoves_ += mesh.active_.size();
+
+    // moved vertices and their neighbours go on, in order of movable_
+    std::vector<int> next;
+    for (size_t i = 0; i < mesh.active_.size(); ++i)
+    {
+      int a = mesh.active_[i];
+      if ( mesh.shift_[i] <= tolerance*tolerance )
+        continue;
+
+      if ( slotMark[a] != n )
+      {
+        slotMark[a] = n;
+        next.push_back(a);
+      }
+
+      for (int j = mesh.ringStart_[a]; j < mesh.ringStart_[a+1]; ++j)
+      {
+        int b = mesh.slot_[mesh.ring_[j]];
+        if ( b < 0 || slotMark[b] == n )
+          continue;
+
+        slotMark[b] = n;
+        next.push_back(b);
+      }
+    }
+    std::sort(next.begin(), next.end());
+    mesh.active_.swap(next);
+  }
+
+  for (size_t i = 0; i < mesh.movable_.size(); ++i)
+  {
+    int v = mesh.movable_[i];
+    verts[v] = Vertex(Vec3f(mesh.x_[0][v], mesh.y_[0][v], mesh.z_[0][v]), Vec3f(mesh.nx_[0][v], mesh.ny_[0][v], mesh.nz_[0][v]));
+  }
+}
+
+namespace
+{
+  // adds scale * row v of uniform Laplacian: deg(v) at v, -1 at neighbours
+  void addLaplacian(int v, double scale, const std::vector<int> & start, const std::vector<int> & neighbours,
+    std::vector<double> & acc, std::vector<int> & touched)
+  {
+    acc[v] += scale * (start[v+1] - start[v]);
+    touched.push_back(v);
+    for (int j = start[v]; j < start[v+1]; ++j)
+    {
+      acc[neighbours[j]] -= scale;
+      touched.push_back(neighbours[j]);
+    }
+  }
+}
+
+/**
+  Inner vertices are placed where uniform Laplacian (order 1) or its square (order 2) vanishes,
+  with boundary as constraints. That is the limit of repeated umbrella smoothing,
+  found by one conjugate gradient solve per coordinate. Normals are kept
+*/
+void DelaunayTriangulator::fair(int order)
+{
+  STAGE_TIMER("fair");
+  TRACE_SCOPE("fair");
+
+  Vertices & verts = container_.verts();
+  const OrEdgesList_shared & edges = container_.edges();
+
+  // undirected neighbours from half-edges, boundary edges have only one half
+  std::vector< std::pair<int, int> > pairs;
+  pairs.reserve(edges.size()*2);
+  for (OrEdgesList_shared::const_iterator i = edges.begin(); i != edges.end(); ++i)
+  {
+    const OrEdge * e = i->get();
+    pairs.push_back(std::make_pair(e->org(), e->dst()));
+    pairs.push_back(std::make_pair(e->dst(), e->org()));
+  }
+  std::sort(pairs.begin(), pairs.end());
+  pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+
+  std::vector<int> start(verts.size()+1, 0), neighbours(pairs.size());
+  for (size_t i = 0; i < pairs.size(); ++i)
+  {
+    start[pairs[i].first+1]++;
+    neighbours[i] = pairs[i].second;
+  }
+  for (size_t v = 0; v < verts.size(); ++v)
+    start[v+1] += start[v];
+
+  std::vector<int> slot(verts.size(), -1), unknowns;
+  for (size_t v = boundary_.size(); v < verts.size(); ++v)
+  {
+    if ( start[v+1] == start[v] )
+      continue;
+
+    slot[v] = (int)unknowns.size();
+    unknowns.push_back((int)v);
+  }
+
+  if ( unknowns.empty() )
+    return;
+
+  // rows of operator for unknowns. columns of fixed vertices go to right side
+  iSparse::Matrix A;
+  std::vector<double> bx(unknowns.size()), by(unknowns.size()), bz(unknowns.size());
+  std::vector<double> acc(verts.size(), 0.0);
+  std::vector<int> touched, columns;
+  std::vector<double> values;
+  for (size_t i = 0; i < unknowns.size(); ++i)
+  {
+    int v = unknowns[i];
+    touched.clear();
+
+    // row v of L*L is deg(v)*L(v) - sum of L(k) over neighbours k
+    if ( order > 1 )
+    {
+      addLaplacian(v, start[v+1] - start[v], start, neighbours, acc, touched);
+      for (int j = start[v]; j < start[v+1]; ++j)
+        addLaplacian(neighbours[j], -1.0, start, neighbours, acc, touched);
+    }
+    else
+      addLaplacian(v, 1.0, start, neighbours, acc, touched);
+
+    std::sort(touched.begin(), touched.end());
+    touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+
+    columns.clear();
+    values.clear();
+    double rx = 0, ry = 0, rz = 0;
+    for (size_t j = 0; j < touched.size(); ++j)
+    {
+      int u = touched[j];
+      double a = acc[u];
+      acc[u] = 0;
+      if ( a == 0 )
+        continue;
+
+      if ( slot[u] >= 0 )
+      {
+        columns.push_back(slot[u]);
+        values.push_back(a);
+      }
+      else
+      {
+        rx -= a * verts[u].p().x;
+        ry -= a * verts[u].p().y;
+        rz -= a * verts[u].p().z;
+      }
+    }
+
+    A.addRow(columns, values);
+    bx[i] = rx;
+    by[i] = ry;
+    bz[i] = rz;
+  }
+
+  // current positions are a good guess
+  std::vector<double> x(unknowns.size()), y(unknowns.size()), z(unknowns.size());
+  for (size_t i = 0; i < unknowns.size(); ++i)
+  {
+    const Vec3f & p = verts[unknowns[i]].p();
+    x[i] = p.x;
+    y[i] = p.y;
+    z[i] = p.z;
+  }
+
+  int maxIters = (int)unknowns.size()*4 + 100;
+  stats_.fairingUnknowns_ += unknowns.size();
+  stats_.fairingIterations_ += iSparse::solveCG(A, bx, x, 1e-8, maxIters, pool_.get());
+  stats_.fairingIterations_ += iSparse::solveCG(A, by, y, 1e-8, maxIters, pool_.get());
+  stats_.fairingIterations_ += iSparse::solveCG(A, bz, z, 1e-8, maxIters, pool_.get());
+
+  for (size_t i = 0; i < unknowns.size(); ++i)
+  {
+    Vertex & vert = verts[unknowns[i]];
+    vert = Vertex(Vec3f(x[i], y[i], z[i]), vert.n());
+  }
+}
+
 void DelaunayTriangulator::smoothPt(OrEdge * edge)
 {
   if ( !edge )
@@ -930,8 +2801,11 @@ void DelaunayTriangulator::smoothPt(OrEdge * edge)
 // Self-intersections
 bool DelaunayTriangulator::selfIsect(OrEdge * edge) const
 {
+  STAGE_TIMER("selfIsect(edge)");
+
   EdgesSet_const items, used, polyline;
-  octree_->collect(edge->rect(), items);
+  Rect3f rc = edge->rect();
+  collect(SelfIsectEdge, rc, items);
 
   const Vec3f & ep0 = container_.verts().at(edge->org()).p();
   const Vec3f & ep1 = container_.verts().at(edge->dst()).p();
@@ -972,7 +2846,10 @@ bool DelaunayTriangulator::selfIsect(OrEdge * edge) const
 
     Vec3f ip;
     if ( iMath::edge_tri_isect(ep0, ep1, tp0, tp1, tp2, ip) )
+    {
+      countHit(SelfIsectEdge);
       return true;
+    }
   }
 
   if ( polyline.empty() )
@@ -1004,7 +2881,10 @@ bool DelaunayTriangulator::selfIsect(OrEdge * edge) const
 
       Vec3f ip;
       if ( iMath::edge_tri_isect(ep0, ep1, tp0, tp1, tp2, ip) )
+      {
+        countHit(SelfIsectEdge);
         return true;
+      }
     }
   }
 
@@ -1013,6 +2893,8 @@ bool DelaunayTriangulator::selfIsect(OrEdge * edge) const
 
 bool DelaunayTriangulator::selfIsect(const Triangle & tr) const
 {
+  STAGE_TIMER("selfIsect(tri)");
+
   const Vec3f & tp0 = container_.verts().at(tr.x).p();
   const Vec3f & tp1 = container_.verts().at(tr.y).p();
   const Vec3f & tp2 = container_.verts().at(tr.z).p();
@@ -1027,14 +2909,12 @@ bool DelaunayTriangulator::selfIsect(const Triangle & tr) const
     OrEdge(tr.z, tr.x, const_cast<EdgesContainer*>(&container_)) };
 
   EdgesSet_const items, used;
-  octree_->collect(rc, items);
+  collect(SelfIsectTri, rc, items);
 
   for (EdgesSet_const::iterator i = items.begin(); i != items.end(); ++i)
   //for (OrEdgesList_shared::const_iterator i = container_.edges().begin(); i != container_.edges().end(); ++i)
   {
     const OrEdge * e = *i;
-    if ( used.find(e) != used.end() )
-      continue;
 
     // touches
     if ( tr.x == e->org() || tr.x == e->dst() ||
@@ -1049,10 +2929,14 @@ bool DelaunayTriangulator::selfIsect(const Triangle & tr) const
 
     Vec3f ip;
     if ( iMath::edge_tri_isect(ep0, ep1, tp0, tp1, tp2, ip) )
+    {
+      countHit(SelfIsectTri);
       return true;
+    }
 
-    // not a triangle
-    if ( e->next()->next()->next() != e )
+    // not a triangle or tested already. its other edges still go through the check above,
+    // so the result doesn't depend on the order of items
+    if ( e->next()->next()->next() != e || used.find(e) != used.end() )
       continue;
 
     used.insert(e->next());
@@ -1076,21 +2960,61 @@ bool DelaunayTriangulator::selfIsect(const Triangle & tr) const
         continue;
       }
 
-      const Vec3f & x0 = container_.verts().at(e->org()).p();
-      const Vec3f & x1 = container_.verts().at(e->dst()).p();
+      const Vec3f & x0 = container_.verts().at(oe.org()).p();
+      const Vec3f & x1 = container_.verts().at(oe.dst()).p();
 
       if ( iMath::edge_tri_isect(x0, x1, q0, q1, q2, ip) )
+      {
+        countHit(SelfIsectTri);
         return true;
+      }
     }
   }
 
   return false;
 }
 
+int DelaunayTriangulator::crossings(const Triangle & tr) const
+{
+  STAGE_TIMER("crossings");
+
+  const Vertices & verts = container_.verts();
+
+  Rect3f rc;
+  rc.add(verts.at(tr.x).p());
+  rc.add(verts.at(tr.y).p());
+  rc.add(verts.at(tr.z).p());
+
+  EdgesSet_const items, used;
+  collect(SelfIsectTri, rc, items);
+
+  int n = 0;
+  for (EdgesSet_const::iterator i = items.begin(); i != items.end(); ++i)
+  {
+    const OrEdge * e = *i;
+    if ( e->next()->next()->next() != e || used.find(e) != used.end() )
+      continue;
+
+    used.insert(e);
+    used.insert(e->next());
+    used.insert(e->next()->next());
+
+    if ( trianglesCross(verts, tr, e->tri()) )
+      n++;
+  }
+
+  if ( n > 0 )
+    countHit(SelfIsectTri);
+  return n;
+}
+
 bool DelaunayTriangulator::haveCrossSections(const OrEdge * edge) const
 {
+  STAGE_TIMER("haveCrossSections");
+
   EdgesSet_const items;
-  octree_->collect(edge->rect(), items);
+  Rect3f rc = edge->rect();
+  collect(CrossSections, rc, items);
 
   const Vec3f & p0 = container_.verts().at(edge->org()).p();
   const Vec3f & p1 = container_.verts().at(edge->dst()).p();
@@ -1105,7 +3029,10 @@ bool DelaunayTriangulator::haveCrossSections(const OrEdge * edge) const
     Vec3f r;
     double dist = 0;
     if ( iMath::edges_isect(p0, p1, q0, q1, r, dist) )
+    {
+      countHit(CrossSections);
       return true;
+    }
   }
 
   return false;
@@ -1219,9 +3146,6 @@ void DelaunayTriangulator::saveBoundary(const char * fname) const
 
   std::ofstream ofs(fname);
 
-  Triangles tris;
-  postbuild(tris);
-
   const Vertices & verts = container_.verts();
 
   ofs << "{\n";
@@ -3,19 +3,100 @@
 #include <stdexcept>
 #include "oredge.h"
 #include "octree.h"
+#include "tristats.h"
+#include "planar.h"
+#include "taskpool.h"
+#include <deque>
+#include <map>
+#include <boost/chrono.hpp>
+
+struct TriangulationOptions
+{
+  TriangulationOptions() :
+    optimizeOrder_(false), renumberVertices_(false), cacheSize_(32),
+    perfCounters_(false), indexDiagnostics_(false),
+    meshQuality_(false), planarFastPath_(false), projectionMode_(false),
+    threads_(1), stableOrder_(false), flipRounds_(false), speculativeSI_(false),
+    vertexSmoothing_(false), smoothIterations_(2), smoothTolerance_(0),
+    fairing_(0), longestFirst_(false)
+  {}
+
+  // reorder output triangles for vertex cache locality
+  bool optimizeOrder_;
+
+  // renumber inner vertices in order of first use by triangles. boundary keeps its indices
+  bool renumberVertices_;
+
+  int cacheSize_;
+
+  // sample hardware counters per stage into TriangulationStats::stages_, pool workers included
+  bool perfCounters_;
+
+  // count bounding box overlaps of index query candidates and dump the final tree shape into stats
+  bool indexDiagnostics_;
+
+  // collect MeshQualityStats while emitting triangles
+  bool meshQuality_;
+
+  // flat boundary is triangulated in its plane by iPlanar instead of ear clipping
+  bool planarFastPath_;
+
+  // curved boundary is triangulated the same way in its best-fit plane, if projection is simple.
+  // flips are then checked against folding in that plane instead of 3d self-intersections
+  bool projectionMode_;
+
+  // worker threads inside one hole, 1 runs everything on the calling thread
+  int threads_;
+
+  // order diagonals made by ear clipping by their ends, so the result doesn't depend on timing of threads_
+  bool stableOrder_;
+
+  // flips without self-intersection checks go in rounds of quads without common vertices,
+  // tested and rotated in parallel with threads_ > 1
+  bool flipRounds_;
+
+  // with threads_ > 1, flips with self-intersection checks are evaluated in parallel before every pass
+  // and made sequentially, evaluation is repeated only where earlier flips changed the mesh
+  bool speculativeSI_;
+
+  // smoothing moves every inner vertex once per iteration, from positions of the previous one. it is split
+  // between threads_ workers, the result doesn't depend on their number.
+  // otherwise edges are walked in creation order and each moves its origin in place, boundary too
+  bool vertexSmoothing_;
+
+  // the most smoothing iterations, smoothTolerance_ can stop vertex smoothing earlier
+  int smoothIterations_;
+
+  // vertex smoothing stops earlier if no vertex moves more than that, relative to edge length.
+  // only moved vertices and their neighbours are smoothed again, 0 smooths all of them every iteration
+  double smoothTolerance_;
+
+  // instead of smoothing, inner vertices are placed by solving Laplacian (1, membrane)
+  // or bi-Laplacian (2, thin plate) system with boundary fixed. 0 smooths
+  int fairing_;
+
+  // refinement splits the longest edge first, otherwise in order of creation
+  bool longestFirst_;
+};
 
 class DelaunayTriangulator
 {
-  typedef std::set <OrEdge*> EdgesSet;
+  typedef std::set <OrEdge*, OrEdgeLess> EdgesSet;
   typedef std::set <const OrEdge*> EdgesSet_const;
   typedef std::list<OrEdge*> EdgesList;
 
+  // edges to be split by refinement, see TriangulationOptions::longestFirst_
+  class SplitQueue;
+
 public:
   
-  DelaunayTriangulator(Vertices & verts);
+  DelaunayTriangulator(Vertices & verts, const TriangulationOptions & options = TriangulationOptions());
   virtual ~DelaunayTriangulator();
 
   void triangulate(Triangles & tris);
+
+  // what was done by constructor and triangulate
+  const TriangulationStats & stats() const;
   void save3d(const char * fname, const char * meshName, const char * plineName, const char * edgesName) const;
   void saveBoundary(const char * fname) const;
   void writeSomething(const char * fname, const Vec3f & p0, const Vec3f & p1, const Vec3f & p2, std::vector<int> &);
@@ -25,36 +106,131 @@ private:
   Vec3f calcPt(const Vec3f & p0, const Vec3f & p1, const Vec3f & n0, const Vec3f & n1, double t) const;
 
   void prebuild();
-  bool needRotate(const OrEdge * e, bool checkSI) const;
+  // rejectedSI is set if rotation is needed but would make self-intersection
+  bool needRotate(const OrEdge * e, bool checkSI, bool * rejectedSI = 0) const;
+  // the same, not counted in stats. safe to call concurrently
+  bool testRotate(const OrEdge * e, bool checkSI, bool * rejectedSI) const;
 
   // returns number of edges rotated
-  int  makeDelaunay(bool checkSI);
+  int  makeDelaunay(bool checkSI, FlipPassStats & pass);
   void makeDelaunayRep(bool checkSI);
+  void makeDelaunayRounds(FlipLoopStats & loop);
+  int  makeDelaunaySpeculative(const EdgesSet & to_delanay, FlipPassStats & pass);
+  void testEdges(const std::vector<OrEdge*> & edges, std::vector<char> & flags, size_t begin, size_t end) const;
+  void rotateEdges(const std::vector<OrEdge*> & edges, std::vector<char> & flags, size_t begin, size_t end);
 
-  void makeDelaunay(EdgesSet & to_delanay, EdgesSet & to_split, EdgesSet & to_exclude);
+  enum Speculation { Keep, Rotate, RejectedSI };
+  void speculate(const std::vector<OrEdge*> & edges, std::vector<char> & results, std::vector<int> & quads, size_t begin, size_t end) const;
+
+  // body(begin, end) over [0, n), split between pool workers if there are any
+  void forEach(size_t n, const TaskPool::Range & body);
+
+  void makeDelaunay(EdgesSet & to_delanay, SplitQueue & to_split);
+  // index of all edges, after stages that don't keep it
+  void reindex();
+  // rotates edges of triangles crossing the mesh, if the new triangles cross less.
+  // indexed is false if the index wasn't kept by stages before
+  void untangle(bool indexed);
   bool getSplitPoint(const OrEdge * , Vertex & ) const;
   void split();
-  void intrusionPoint(OrEdge * from);
+  struct PrebuildTask;
+  // task is null on the calling thread, then new edges go to the index right away.
+  // pool tasks only read the index and keep their diagonals in the task instead, see prebuild
+  void intrusionPoint(OrEdge * from, PrebuildTask * task);
+  void addDiagonal(OrEdge * e, PrebuildTask * task);
+  // adds diagonals of prebuild tasks to the index, false if there are more tasks and any two diagonals cross
+  bool commitDiagonals();
+  // back to the boundary loop of the first n edges
+  void undoDiagonals(size_t n);
+
+  // false if boundary is not flat, or can't be projected with projectionMode_, or projection is not simple
+  bool planarBuild(OrEdge * from);
 
-  void postbuild(Triangles &) const;
+  // rotated edge would fold the mesh over in the projection plane
+  bool foldsProjection(const OrEdge * edge) const;
+
+  void postbuild(Triangles &, MeshQualityStats * quality = 0) const;
+  void measureEdge(const OrEdge * e, MeshQualityStats & quality) const;
+  void measureTriangle(const Triangle & tr, MeshQualityStats & quality) const;
+  bool isDelaunay(const OrEdge * e) const;
 
   // edge->org() is convex point
   OrEdge * findConvexEdge(OrEdge * from, OrEdge *& cv_prev);
   OrEdge * findConvexEdgeAlt(OrEdge * from, OrEdge *& cv_prev);
 
   bool isEdgeConvex(const OrEdge * edge) const;
+  // v1 is convex between v0 and v2
+  bool isConvex(int v0, int v1, int v2) const;
 
   // edge->dst() is intrude point
   OrEdge * findIntrudeEdge(OrEdge * cv_edge);
 
+  bool hasArea(const Triangle & tr) const;
+  // triangle has area, unless it has coincident points, and doesn't cross triangles or edges made before
+  bool isTriangleValid(const Triangle & tr) const;
+  // triangles made by cutting the ear at cv_edge->dst(), or by the diagonal to ir_edge->dst() if there is
+  // intrude point, are valid. so is the rest of polygon if it is a triangle
+  bool isCutValid(const OrEdge * cv_edge, const OrEdge * ir_edge) const;
+  // replaces cut at cv_edge by the best valid one of polygon from, false if there is none
+  bool findValidCut(OrEdge * from, OrEdge *& cv_edge, OrEdge *& cv_prev, OrEdge *& ir_edge);
+
+  // clips polygon of up to 8 edges into valid triangles not crossing each other, false if there is no way
+  bool triangulateSmall(OrEdge * from, PrebuildTask * task);
+
+  // triangles of the same vertices in any order, for searchEars
+  struct TriangleLess
+  {
+    bool operator () (const Triangle & a, const Triangle & b) const;
+  };
+
+  // depth first search of ears leaving polygon pts in valid triangles. order gets apexes of ears
+  // to clip one by one, tris - their triangles. valid caches isTriangleValid
+  bool searchEars(std::vector<int> & pts, std::vector<Triangle> & tris, std::vector<int> & order,
+                  std::map<Triangle, bool, TriangleLess> & valid) const;
+
+  // cuts ear at cv_edge->dst(), returns new edge of the rest of polygon
+  OrEdge * clipEar(OrEdge * cv_prev, OrEdge * cv_edge, PrebuildTask * task);
+
   void smooth(int itersN);
   void smoothPt(OrEdge * edge);
+  void smoothVertices(int itersN);
+
+  // order 1 or 2, see TriangulationOptions::fairing_
+  void fair(int order);
 
   // self-intersections
   bool selfIsect(OrEdge * edge) const;
   bool selfIsect(const Triangle & tr) const;
+  // number of triangles without common vertices crossing tr
+  int  crossings(const Triangle & tr) const;
   bool haveCrossSections(const OrEdge * ) const;
 
+  // index queries may come from several threads, every worker counts them in its WorkerQueries.
+  // updateIndexStats adds them up into stats_ when workers are done
+  enum IndexQuery { SelfIsectEdge, SelfIsectTri, CrossSections, QueriesN };
+  struct WorkerQueries
+  {
+    WorkerQueries() : collects_(0), collected_(0), task_(0) {}
+
+    IndexQueryStats queries_[QueriesN];
+    size_t collects_, collected_;
+
+    // prebuild task the worker runs, its diagonals are collected too
+    const PrebuildTask * task_;
+  };
+
+  void updateIndexStats() const;
+  WorkerQueries & workerQueries() const;
+  void collect(IndexQuery query, const Rect3f & rc, EdgesSet_const & items) const;
+  void countHit(IndexQuery query) const;
+  void countQuery(IndexQueryStats & query, const Rect3f & rc, const EdgesSet_const & items) const;
+
+  // stage wall time and hardware counters
+  void beginStage(const char * name);
+  void endStage();
+
+  TriangulationOptions options_;
+
   double edgeLength_;
   double rotateThreshold_;
   double splitThreshold_;
@@ -66,5 +242,37 @@ private:
   EdgesContainer container_;
   std::vector<size_t> boundary_;
 
+  // boundary lies in one plane, see planarBuild
+  bool planar_;
+
+  // boundary was projected to its best-fit plane, plane_ keeps 2d boundary points
+  bool projected_;
+  Points3f plane_;
+
   boost::shared_ptr< OcTree<OrEdge> > octree_;
+
+  mutable TriangulationStats stats_;
+
+  // parallel stages, with threads_ > 1 only
+  boost::shared_ptr<TaskPool> pool_;
+
+  // edges creation and stats updates from prebuild tasks
+  boost::mutex buildMutex_;
+  // diagonals of a prebuild task go to octree_ when all tasks are done, see commitDiagonals.
+  // till then index_ shows the task its own diagonals and the ones made before it was split off
+  struct PrebuildTask
+  {
+    std::vector<OrEdge*> diagonals_;
+    std::vector<OrEdge*> visible_;
+    boost::shared_ptr< OcTree<OrEdge> > index_;
+  };
+  std::deque<PrebuildTask> tasks_;
+  // index query counters, one per worker
+  mutable std::vector<WorkerQueries> queries_;
+
+  boost::shared_ptr<PerfCounters> perf_;
+  StageStats stage_;
+  PerfReading perfStart_;
+  boost::chrono::steady_clock::time_point stageStart_;
+  long long allocBase_;
 };
@@ -0,0 +1,84 @@
+#include "engine.h"
+#include <algorithm>
+#include <boost/thread/thread.hpp>
+
+DelaunayEngine::DelaunayEngine(const std::string & name, const TriangulationOptions & options) :
+  name_(name), options_(options)
+{
+}
+
+std::string DelaunayEngine::name() const
+{
+  return name_;
+}
+
+void DelaunayEngine::triangulate(Vertices & verts, Triangles & tris, TriangulationStats * stats)
+{
+  DelaunayTriangulator dtr(verts, options_);
+  dtr.triangulate(tris);
+  if ( stats )
+    *stats = dtr.stats();
+}
+
+//////////////////////////////////////////////////////////////////////////
+TriangulationOptions iEngine::legacyOptions()
+{
+  TriangulationOptions options;
+  options.optimizeOrder_ = false;
+  options.renumberVertices_ = false;
+  options.planarFastPath_ = false;
+  options.projectionMode_ = false;
+  options.stableOrder_ = false;
+  options.flipRounds_ = false;
+  options.speculativeSI_ = false;
+  options.vertexSmoothing_ = false;
+  options.longestFirst_ = false;
+  return options;
+}
+
+void iEngine::enableOptimizations(TriangulationOptions & options)
+{
+  options.stableOrder_ = true;
+  options.planarFastPath_ = true;
+  options.projectionMode_ = true;
+  options.flipRounds_ = true;
+  options.speculativeSI_ = true;
+  options.vertexSmoothing_ = true;
+  options.smoothTolerance_ = 1e-3;
+  options.longestFirst_ = true;
+}
+
+TriangulationEngine_shared iEngine::create(const std::string & name)
+{
+  if ( name == "reference" )
+    return TriangulationEngine_shared( new DelaunayEngine(name, legacyOptions()) );
+
+  if ( name == "default" )
+    return TriangulationEngine_shared( new DelaunayEngine(name, TriangulationOptions()) );
+
+  if ( name == "fast" )
+  {
+    TriangulationOptions options;
+    enableOptimizations(options);
+    return TriangulationEngine_shared( new DelaunayEngine(name, options) );
+  }
+
+  if ( name == "parallel" )
+  {
+    TriangulationOptions options;
+    enableOptimizations(options);
+    options.threads_ = std::max(2, (int)boost::thread::hardware_concurrency());
+    return TriangulationEngine_shared( new DelaunayEngine(name, options) );
+  }
+
+  return TriangulationEngine_shared();
+}
+
+void iEngine::names(std::vector<std::string> & names)
+{
+  names.clear();
+  names.push_back("reference");
+  names.push_back("default");
+  names.push_back("fast");
+  names.push_back("parallel");
+}
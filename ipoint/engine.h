@@ -0,0 +1,60 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include "delaunay.h"
+
+/**
+  Triangulation implementation as seen by the tools comparing and benchmarking them.
+
+  verts holds the boundary on input, inner points are appended to it.
+  Boundary vertices keep their indices.
+*/
+class TriangulationEngine
+{
+public:
+
+  virtual ~TriangulationEngine() {}
+
+  virtual std::string name() const = 0;
+
+  // throws std::exception if triangulation fails. stats may be 0
+  virtual void triangulate(Vertices & verts, Triangles & tris, TriangulationStats * stats) = 0;
+};
+
+typedef boost::shared_ptr<TriangulationEngine> TriangulationEngine_shared;
+
+// DelaunayTriangulator with given options
+class DelaunayEngine : public TriangulationEngine
+{
+public:
+
+  DelaunayEngine(const std::string & name, const TriangulationOptions & options);
+
+  std::string name() const;
+  void triangulate(Vertices & verts, Triangles & tris, TriangulationStats * stats);
+
+private:
+
+  std::string name_;
+  TriangulationOptions options_;
+};
+
+namespace iEngine
+{
+
+// options of the original algorithm, new optimizations switched off
+TriangulationOptions legacyOptions();
+
+// switches on optimizations that change the triangulation, other options are kept
+void enableOptimizations(TriangulationOptions & options);
+
+// "reference" - the original algorithm, "default" - DelaunayTriangulator defaults,
+// "fast" - all optimizations, "parallel" - same on several threads
+// returns empty pointer for unknown name
+TriangulationEngine_shared create(const std::string & name);
+
+void names(std::vector<std::string> & names);
+
+}
@@ -2,6 +2,18 @@
 
 #undef USE_VERIFICATION
 
+// dump intermediate meshes to the files for debugging
+#undef USE_DEBUG_DUMP
+
+// per stage timers, see iprofile.h
+#undef USE_STAGE_TIMERS
+
+// chrome trace events recording, see iprofile.h
+#undef USE_TRACE_EVENTS
+
+// count heap allocations by replacing global new/delete, see alloctrack.h
+#undef USE_ALLOC_TRACKING
+
 #ifdef USE_VERIFICATION
   #define THROW_IF(cond, msg) if ( cond ) throw std::runtime_error(msg); else;
   #define DO_VERIFY( action ) action;
@@ -9,4 +21,10 @@
 #else
   #define THROW_IF(cond, msg) ;
   #define DO_VERIFY( action ) ;
+#endif
+
+#ifdef USE_DEBUG_DUMP
+  #define DO_DUMP( action ) action;
+#else
+  #define DO_DUMP( action ) ;
 #endif
\ No newline at end of file
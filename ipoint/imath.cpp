@@ -1,4 +1,5 @@
 #include "imath.h"
+#include "icommon.h"
 
 
 extern const double iMath::err = 1e-10;
@@ -175,6 +176,7 @@ bool iMath::edge_tri_isect(const Vec3f & ep0, const Vec3f & ep1, const Vec3f & t
     return false;
 
   bool ok = inside_tri(tp0, tp1, tp2, ip);
+#ifdef USE_DEBUG_DUMP
   if ( ok )
   {
     std::ofstream ofs("D:\\Scenes\\3dpad\\isect.txt");
@@ -218,5 +220,6 @@ bool iMath::edge_tri_isect(const Vec3f & ep0, const Vec3f & ep1, const Vec3f & t
 
     ofs << "}\n";
   }
+#endif
   return ok;
 }
@@ -7,23 +7,17 @@ TARGET =
 DEPENDPATH += .
 INCLUDEPATH += .
 
+include(core.pri)
+
 # Input
-HEADERS += delaunay.h \
-           imath.h \
-           ipoint.h \
+HEADERS += ipoint.h \
            ipoint_alg.h \
            iview.h \
-           oredge.h \
-           rect.h \
-           utils.h \
-           vec.h
-SOURCES += delaunay.cpp \
-           imath.cpp \
-           ipoint.cpp \
+           utils.h
+SOURCES += ipoint.cpp \
            ipoint_alg.cpp \
            iview.cpp \
-           main.cpp \
-           oredge.cpp
+           main.cpp
 RESOURCES += ipoint.qrc
 
 CONFIG(debug, debug|release) {
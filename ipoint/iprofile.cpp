@@ -0,0 +1,509 @@
+#include "iprofile.h"
+#include <ostream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <iomanip>
+#include <boost/thread/tss.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/chrono.hpp>
+#include <boost/atomic.hpp>
+
+#ifdef USE_STAGE_TIMERS
+
+namespace iProfile
+{
+
+struct TimerNode
+{
+  TimerNode(const char * name, TimerNode * parent) :
+    name_(name), parent_(parent), total_(0), calls_(0)
+  {}
+
+  ~TimerNode()
+  {
+    for (size_t i = 0; i < children_.size(); ++i)
+      delete children_[i];
+  }
+
+  TimerNode * child(const char * name)
+  {
+    // names are usually the same literals, compare pointers first
+    for (size_t i = 0; i < children_.size(); ++i)
+    {
+      if ( children_[i]->name_ == name )
+        return children_[i];
+    }
+
+    for (size_t i = 0; i < children_.size(); ++i)
+    {
+      if ( !strcmp(children_[i]->name_, name) )
+        return children_[i];
+    }
+
+    children_.push_back( new TimerNode(name, this) );
+    return children_.back();
+  }
+
+  void merge(const TimerNode & other)
+  {
+    total_ += other.total_;
+    calls_ += other.calls_;
+    for (size_t i = 0; i < other.children_.size(); ++i)
+      child(other.children_[i]->name_)->merge(*other.children_[i]);
+  }
+
+  void reset()
+  {
+    total_ = 0;
+    calls_ = 0;
+    for (size_t i = 0; i < children_.size(); ++i)
+      children_[i]->reset();
+  }
+
+  const char * name_;
+  TimerNode * parent_;
+  std::vector<TimerNode*> children_;
+  boost::chrono::nanoseconds::rep total_;
+  size_t calls_;
+};
+
+namespace
+{
+  struct ThreadTimers
+  {
+    ThreadTimers() : root_("", 0), current_(&root_), worker_(false) {}
+
+    TimerNode root_;
+    TimerNode * current_;
+    bool worker_;
+  };
+
+  boost::mutex registryMutex_;
+  std::vector<ThreadTimers*> registry_;
+
+  // timers of finished threads
+  TimerNode retired_("", 0);
+  TimerNode retiredWorkers_("", 0);
+
+  void retireThread(ThreadTimers * timers)
+  {
+    boost::mutex::scoped_lock lock(registryMutex_);
+    (timers->worker_ ? retiredWorkers_ : retired_).merge(timers->root_);
+    for (size_t i = 0; i < registry_.size(); ++i)
+    {
+      if ( registry_[i] == timers )
+      {
+        registry_.erase(registry_.begin() + i);
+        break;
+      }
+    }
+    delete timers;
+  }
+
+  boost::thread_specific_ptr<ThreadTimers> threadTimers_(&retireThread);
+
+  ThreadTimers * getThreadTimers()
+  {
+    ThreadTimers * timers = threadTimers_.get();
+    if ( !timers )
+    {
+      timers = new ThreadTimers;
+      threadTimers_.reset(timers);
+      boost::mutex::scoped_lock lock(registryMutex_);
+      registry_.push_back(timers);
+    }
+    return timers;
+  }
+
+  void writeNode(std::ostream & os, const TimerNode & node, int level)
+  {
+    double total = node.total_ * 1e-6;
+    double children = 0;
+    for (size_t i = 0; i < node.children_.size(); ++i)
+      children += node.children_[i]->total_ * 1e-6;
+
+    os << std::string(level*2, ' ') << std::left << std::setw(40 - level*2) << node.name_
+      << std::right << std::setw(12) << node.calls_
+      << std::setw(14) << std::fixed << std::setprecision(3) << total
+      << std::setw(14) << total - children << "\n";
+
+    for (size_t i = 0; i < node.children_.size(); ++i)
+      writeNode(os, *node.children_[i], level+1);
+  }
+}
+
+ScopedTimer::ScopedTimer(const char * name)
+{
+  ThreadTimers * timers = getThreadTimers();
+  node_ = timers->current_ = timers->current_->child(name);
+  start_ = boost::chrono::steady_clock::now();
+}
+
+ScopedTimer::~ScopedTimer()
+{
+  boost::chrono::steady_clock::duration d = boost::chrono::steady_clock::now() - start_;
+  node_->total_ += boost::chrono::duration_cast<boost::chrono::nanoseconds>(d).count();
+  node_->calls_++;
+  threadTimers_.get()->current_ = node_->parent_;
+}
+
+void writeTimers(std::ostream & os)
+{
+  TimerNode merged("", 0), workers("", 0);
+  {
+    boost::mutex::scoped_lock lock(registryMutex_);
+    merged.merge(retired_);
+    workers.merge(retiredWorkers_);
+    for (size_t i = 0; i < registry_.size(); ++i)
+      (registry_[i]->worker_ ? workers : merged).merge(registry_[i]->root_);
+  }
+
+  os << std::left << std::setw(40) << "stage" << std::right << std::setw(12) << "calls"
+    << std::setw(14) << "total, ms" << std::setw(14) << "self, ms" << "\n";
+
+  for (size_t i = 0; i < merged.children_.size(); ++i)
+    writeNode(os, *merged.children_[i], 0);
+
+  // summed over workers, stages above include the time they waited for them
+  if ( !workers.children_.empty() )
+  {
+    os << "worker threads\n";
+    for (size_t i = 0; i < workers.children_.size(); ++i)
+      writeNode(os, *workers.children_[i], 1);
+  }
+}
+
+void resetTimers()
+{
+  boost::mutex::scoped_lock lock(registryMutex_);
+  retired_.reset();
+  retiredWorkers_.reset();
+  for (size_t i = 0; i < registry_.size(); ++i)
+    registry_[i]->root_.reset();
+}
+
+void setWorkerThread()
+{
+  ThreadTimers * timers = getThreadTimers();
+  boost::mutex::scoped_lock lock(registryMutex_);
+  timers->worker_ = true;
+}
+
+}
+
+#else
+
+void iProfile::writeTimers(std::ostream & )
+{
+}
+
+void iProfile::resetTimers()
+{
+}
+
+void iProfile::setWorkerThread()
+{
+}
+
+#endif
+
+//////////////////////////////////////////////////////////////////////////
+#ifdef USE_TRACE_EVENTS
+
+namespace iProfile
+{
+
+namespace
+{
+  typedef long long TraceTime;
+
+  struct TraceEvent
+  {
+    const char * name_;
+    TraceTime start_, dur_;
+
+    // JSON members of "args" object
+    std::string args_;
+  };
+
+  struct ThreadTrace
+  {
+    ThreadTrace() : tid_(0), session_(0), finished_(false) {}
+
+    int tid_;
+    std::string name_;
+    unsigned session_;
+    bool finished_;
+    std::vector<TraceEvent> events_;
+    std::vector<int> open_;
+  };
+
+  boost::mutex traceMutex_;
+  std::vector<ThreadTrace*> traces_;
+  int tidNext_ = 1;
+  boost::atomic<bool> tracing_(false);
+
+  // threads see new session in beginEvent and drop their old events themselves
+  boost::atomic<unsigned> session_(0);
+
+  // steady clock nanoseconds
+  boost::atomic<long long> traceStart_(0);
+
+  // finished threads' traces are kept until the next startTrace
+  void finishThread(ThreadTrace * trace)
+  {
+    boost::mutex::scoped_lock lock(traceMutex_);
+    trace->finished_ = true;
+  }
+
+  boost::thread_specific_ptr<ThreadTrace> threadTrace_(&finishThread);
+
+  ThreadTrace * getThreadTrace()
+  {
+    ThreadTrace * trace = threadTrace_.get();
+    if ( !trace )
+    {
+      trace = new ThreadTrace;
+      threadTrace_.reset(trace);
+      boost::mutex::scoped_lock lock(traceMutex_);
+      trace->tid_ = tidNext_++;
+      traces_.push_back(trace);
+    }
+    return trace;
+  }
+
+  long long steadyNow()
+  {
+    boost::chrono::steady_clock::duration d = boost::chrono::steady_clock::now().time_since_epoch();
+    return boost::chrono::duration_cast<boost::chrono::nanoseconds>(d).count();
+  }
+
+  TraceTime traceNow()
+  {
+    return steadyNow() - traceStart_;
+  }
+
+  int beginEvent(const char * name)
+  {
+    if ( !tracing_ )
+      return -1;
+
+    ThreadTrace * trace = getThreadTrace();
+    unsigned session = session_;
+    if ( trace->session_ != session )
+    {
+      trace->session_ = session;
+      trace->events_.clear();
+      trace->open_.clear();
+    }
+
+    TraceEvent e;
+    e.name_ = name;
+    e.start_ = traceNow();
+    e.dur_ = -1;
+    trace->events_.push_back(e);
+    trace->open_.push_back((int)trace->events_.size()-1);
+    return trace->open_.back();
+  }
+
+  void endEvent(int index)
+  {
+    if ( index < 0 )
+      return;
+
+    ThreadTrace * trace = threadTrace_.get();
+    if ( !trace || trace->open_.empty() || trace->open_.back() != index )
+      return;
+
+    TraceEvent & e = trace->events_[index];
+    e.dur_ = traceNow() - e.start_;
+    trace->open_.pop_back();
+  }
+
+  void addArg(const std::string & arg)
+  {
+    ThreadTrace * trace = threadTrace_.get();
+    if ( !tracing_ || !trace || trace->open_.empty() )
+      return;
+
+    std::string & args = trace->events_[trace->open_.back()].args_;
+    if ( !args.empty() )
+      args += ", ";
+    args += arg;
+  }
+
+  std::string quoted(const std::string & str)
+  {
+    std::string result = "\"";
+    for (std::string::const_iterator i = str.begin(); i != str.end(); ++i)
+    {
+      if ( *i == '"' || *i == '\\' )
+        result += '\\';
+      if ( (unsigned char)*i < 0x20 )
+        continue;
+      result += *i;
+    }
+    result += '"';
+    return result;
+  }
+
+  void writeTime(std::ostream & os, TraceTime t)
+  {
+    // microseconds
+    os << t/1000 << "." << std::setw(3) << std::setfill('0') << t%1000 << std::setfill(' ');
+  }
+}
+
+TraceScope::TraceScope(const char * name) : index_(beginEvent(name))
+{
+}
+
+TraceScope::~TraceScope()
+{
+  endEvent(index_);
+}
+
+TraceBatch::TraceBatch(const char * name, int size) :
+  name_(name), size_(size > 0 ? size : 1), ticks_(0), index_(-1), first_(0)
+{
+  begin();
+}
+
+TraceBatch::~TraceBatch()
+{
+  end();
+}
+
+void TraceBatch::tick()
+{
+  if ( ++ticks_ % size_ )
+    return;
+
+  end();
+  begin();
+}
+
+void TraceBatch::begin()
+{
+  first_ = ticks_;
+  index_ = beginEvent(name_);
+}
+
+void TraceBatch::end()
+{
+  if ( index_ < 0 )
+    return;
+
+  traceArg("first", first_);
+  traceArg("iterations", ticks_ - first_);
+  endEvent(index_);
+  index_ = -1;
+}
+
+void traceArg(const char * key, double value)
+{
+  std::ostringstream oss;
+  oss << quoted(key) << ": " << value;
+  addArg(oss.str());
+}
+
+void traceArg(const char * key, const std::string & value)
+{
+  addArg(quoted(key) + ": " + quoted(value));
+}
+
+void startTrace()
+{
+  boost::mutex::scoped_lock lock(traceMutex_);
+
+  // buffers of live threads are theirs, old events are skipped by writeTrace until they are dropped
+  for (size_t i = 0; i < traces_.size(); )
+  {
+    if ( traces_[i]->finished_ )
+    {
+      delete traces_[i];
+      traces_.erase(traces_.begin() + i);
+      continue;
+    }
+    ++i;
+  }
+  traceStart_ = steadyNow();
+  session_++;
+  tracing_ = true;
+}
+
+void stopTrace()
+{
+  tracing_ = false;
+}
+
+void setThreadName(const std::string & name)
+{
+  ThreadTrace * trace = getThreadTrace();
+  boost::mutex::scoped_lock lock(traceMutex_);
+  trace->name_ = name;
+}
+
+void writeTrace(std::ostream & os)
+{
+  boost::mutex::scoped_lock lock(traceMutex_);
+
+  os << "{\"traceEvents\": [\n";
+
+  bool first = true;
+  for (size_t i = 0; i < traces_.size(); ++i)
+  {
+    const ThreadTrace & trace = *traces_[i];
+    if ( trace.session_ != session_ || trace.events_.empty() )
+      continue;
+
+    std::ostringstream name;
+    if ( trace.name_.empty() )
+      name << "thread " << trace.tid_;
+    else
+      name << trace.name_;
+
+    os << (first ? "" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << trace.tid_
+      << ", \"args\": {\"name\": " << quoted(name.str()) << "}}";
+    first = false;
+
+    for (size_t j = 0; j < trace.events_.size(); ++j)
+    {
+      const TraceEvent & e = trace.events_[j];
+      if ( e.dur_ < 0 )
+        continue;
+
+      os << ",\n{\"name\": " << quoted(e.name_) << ", \"cat\": \"triangulation\", \"ph\": \"X\", \"ts\": ";
+      writeTime(os, e.start_);
+      os << ", \"dur\": ";
+      writeTime(os, e.dur_);
+      os << ", \"pid\": 1, \"tid\": " << trace.tid_ << ", \"args\": {" << e.args_ << "}}";
+    }
+  }
+
+  os << "\n], \"displayTimeUnit\": \"ms\"}\n";
+}
+
+}
+
+#else
+
+void iProfile::startTrace()
+{
+}
+
+void iProfile::stopTrace()
+{
+}
+
+void iProfile::setThreadName(const std::string & )
+{
+}
+
+void iProfile::writeTrace(std::ostream & )
+{
+}
+
+#endif
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <iosfwd>
+#include <string>
+#include "icommon.h"
+
+/**
+  Hierarchical scoped timers
+
+  STAGE_TIMER("name") measures the enclosing scope, nested timers become
+  children of the enclosing one. Times are accumulated per thread and merged
+  by writeTimers(). Timers of worker threads don't know the stage that gave them
+  work, they are merged separately. Without USE_STAGE_TIMERS the timers are compiled out.
+*/
+
+#define STAGE_TIMER_CAT2(a, b) a##b
+#define STAGE_TIMER_CAT(a, b) STAGE_TIMER_CAT2(a, b)
+
+#ifdef USE_STAGE_TIMERS
+
+#include <boost/chrono.hpp>
+
+namespace iProfile
+{
+
+struct TimerNode;
+
+class ScopedTimer
+{
+public:
+
+  ScopedTimer(const char * name);
+  ~ScopedTimer();
+
+private:
+
+  TimerNode * node_;
+  boost::chrono::steady_clock::time_point start_;
+};
+
+}
+
+  #define STAGE_TIMER(name) iProfile::ScopedTimer STAGE_TIMER_CAT(stage_timer_, __LINE__)(name);
+#else
+  #define STAGE_TIMER(name) ;
+#endif
+
+namespace iProfile
+{
+
+// writes timers of all threads merged by stage path. call it when timed code is idle
+void writeTimers(std::ostream & os);
+
+void resetTimers();
+
+// timers of the calling thread are written under worker threads, not as stages
+void setWorkerThread();
+
+}
+
+/**
+  Chrome/Perfetto trace events
+
+  TRACE_SCOPE("name") records the enclosing scope as complete event on the
+  track of current thread, TRACE_ARG attaches argument to the innermost
+  recorded scope. TRACE_BATCH/TRACE_BATCH_TICK record one event per 'size'
+  iterations of a loop. Events are recorded only between startTrace() and
+  stopTrace(). Without USE_TRACE_EVENTS the events are compiled out.
+*/
+
+#ifdef USE_TRACE_EVENTS
+
+namespace iProfile
+{
+
+class TraceScope
+{
+public:
+
+  TraceScope(const char * name);
+  ~TraceScope();
+
+private:
+
+  int index_;
+};
+
+class TraceBatch
+{
+public:
+
+  TraceBatch(const char * name, int size);
+  ~TraceBatch();
+
+  void tick();
+
+private:
+
+  void begin();
+  void end();
+
+  const char * name_;
+  int size_, ticks_, index_, first_;
+};
+
+void traceArg(const char * key, double value);
+void traceArg(const char * key, const std::string & value);
+
+}
+
+  #define TRACE_SCOPE(name) iProfile::TraceScope STAGE_TIMER_CAT(trace_scope_, __LINE__)(name);
+  #define TRACE_ARG(key, value) iProfile::traceArg(key, value);
+  #define TRACE_BATCH(name, size) iProfile::TraceBatch trace_batch_(name, size);
+  #define TRACE_BATCH_TICK() trace_batch_.tick();
+#else
+  #define TRACE_SCOPE(name) ;
+  #define TRACE_ARG(key, value) ;
+  #define TRACE_BATCH(name, size) ;
+  #define TRACE_BATCH_TICK() ;
+#endif
+
+namespace iProfile
+{
+
+// clears recorded events and starts recording
+void startTrace();
+void stopTrace();
+
+// name of the current thread's track
+void setThreadName(const std::string & name);
+
+// writes trace events JSON. call it when traced code is idle
+void writeTrace(std::ostream & os);
+
+}
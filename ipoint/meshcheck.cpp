@@ -0,0 +1,243 @@
+#include "meshcheck.h"
+#include "imath.h"
+#include <map>
+#include <set>
+#include <ostream>
+#include <math.h>
+#include <algorithm>
+
+MeshCheck::MeshCheck() :
+  degenerate_(0), nonManifold_(0), open_(0),
+  boundaryMissing_(0), boundaryFlipped_(0), selfIntersections_(0),
+  boundaryMoved_(0), boundaryShift_(0)
+{
+}
+
+bool MeshCheck::valid() const
+{
+  return !degenerate_ && !nonManifold_ && !open_ && !boundaryMissing_ && !boundaryFlipped_ && !selfIntersections_ &&
+    !boundaryMoved_;
+}
+
+namespace
+{
+  typedef std::pair<int, int> Edge;
+
+  bool isBoundary(int a, int b, size_t boundaryN)
+  {
+    int n = (int)boundaryN;
+    if ( a >= n || b >= n )
+      return false;
+    return (a+1) % n == b || (b+1) % n == a;
+  }
+
+  bool shareVertex(const Triangle & t, const Triangle & s)
+  {
+    for (int i = 0; i < 3; ++i)
+    {
+      if ( t.v[i] == s.x || t.v[i] == s.y || t.v[i] == s.z )
+        return true;
+    }
+    return false;
+  }
+
+  // edges of one triangle crossing the other one
+  bool trisIsect(const Vertices & verts, const Triangle & t, const Triangle & s)
+  {
+    for (int k = 0; k < 2; ++k)
+    {
+      const Triangle & a = k ? s : t;
+      const Triangle & b = k ? t : s;
+      for (int i = 0; i < 3; ++i)
+      {
+        Vec3f ip;
+        if ( iMath::edge_tri_isect(verts[a.v[i]].p(), verts[a.v[(i+1)%3]].p(),
+                                   verts[b.x].p(), verts[b.y].p(), verts[b.z].p(), ip) )
+        {
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  void checkBoundaryMoved(const Vertices & boundary, const Vertices & verts, MeshCheck & check)
+  {
+    Rect3f rect;
+    for (size_t i = 0; i < boundary.size(); ++i)
+      rect.add(boundary[i].p());
+    double tolerance = rect.diagonal().length() * 1e-9;
+
+    for (size_t i = 0; i < boundary.size(); ++i)
+    {
+      double shift = i < verts.size() ? (verts[i].p() - boundary[i].p()).length() : 0;
+      if ( shift <= tolerance )
+        continue;
+
+      check.boundaryMoved_++;
+      check.boundaryShift_ = std::max(check.boundaryShift_, shift);
+    }
+  }
+}
+
+// uniform grid of cells about 2 mean edge lengths, triangles are tested against the ones sharing a cell
+void iMesh::findSelfIntersections(const Vertices & verts, const Triangles & tris, std::vector< std::pair<int, int> > & pairs)
+{
+  Rect3f rect;
+  double length = 0;
+  for (size_t i = 0; i < tris.size(); ++i)
+  {
+    for (int j = 0; j < 3; ++j)
+    {
+      rect.add(verts[tris[i].v[j]].p());
+      length += (verts[tris[i].v[j]].p() - verts[tris[i].v[(j+1)%3]].p()).length();
+    }
+  }
+
+  pairs.clear();
+  if ( tris.empty() || length <= 0 )
+    return;
+
+  double cell = 2*length / (tris.size()*3);
+  typedef std::map<long long, std::vector<int> > Grid;
+  Grid grid;
+  for (size_t i = 0; i < tris.size(); ++i)
+  {
+    Rect3f rc;
+    for (int j = 0; j < 3; ++j)
+      rc.add(verts[tris[i].v[j]].p());
+
+    long long x0 = (long long)floor((rc.vmin.x - rect.vmin.x)/cell), x1 = (long long)floor((rc.vmax.x - rect.vmin.x)/cell);
+    long long y0 = (long long)floor((rc.vmin.y - rect.vmin.y)/cell), y1 = (long long)floor((rc.vmax.y - rect.vmin.y)/cell);
+    long long z0 = (long long)floor((rc.vmin.z - rect.vmin.z)/cell), z1 = (long long)floor((rc.vmax.z - rect.vmin.z)/cell);
+    for (long long x = x0; x <= x1; ++x)
+      for (long long y = y0; y <= y1; ++y)
+        for (long long z = z0; z <= z1; ++z)
+          grid[(x << 42) ^ (y << 21) ^ z].push_back((int)i);
+  }
+
+  std::set<Edge> found;
+  for (Grid::const_iterator c = grid.begin(); c != grid.end(); ++c)
+  {
+    const std::vector<int> & items = c->second;
+    for (size_t i = 0; i < items.size(); ++i)
+    {
+      for (size_t j = i+1; j < items.size(); ++j)
+      {
+        const Triangle & t = tris[items[i]];
+        const Triangle & s = tris[items[j]];
+        if ( shareVertex(t, s) || !trisIsect(verts, t, s) )
+          continue;
+
+        found.insert(Edge(std::min(items[i], items[j]), std::max(items[i], items[j])));
+      }
+    }
+  }
+
+  pairs.assign(found.begin(), found.end());
+}
+
+void iMesh::checkMesh(const Vertices & boundary, const Vertices & verts, const Triangles & tris, MeshCheck & check)
+{
+  check = MeshCheck();
+  size_t boundaryN = boundary.size();
+
+  // directed edges usage
+  std::map<Edge, int> edges;
+  for (Triangles::const_iterator i = tris.begin(); i != tris.end(); ++i)
+  {
+    const Triangle & t = *i;
+    if ( t.x == t.y || t.y == t.z || t.z == t.x )
+    {
+      check.degenerate_++;
+      continue;
+    }
+
+    Vec3f n = (verts[t.y].p() - verts[t.x].p()) ^ (verts[t.z].p() - verts[t.x].p());
+    if ( n.length() < iMath::err )
+      check.degenerate_++;
+
+    for (int j = 0; j < 3; ++j)
+      edges[Edge(t.v[j], t.v[(j+1)%3])]++;
+  }
+
+  size_t forward = 0, backward = 0;
+  for (std::map<Edge, int>::const_iterator i = edges.begin(); i != edges.end(); ++i)
+  {
+    int a = i->first.first, b = i->first.second;
+    std::map<Edge, int>::const_iterator r = edges.find(Edge(b, a));
+    int n = i->second, rn = r != edges.end() ? r->second : 0;
+
+    if ( n > 1 )
+      check.nonManifold_++;
+
+    if ( isBoundary(a, b, boundaryN) )
+    {
+      if ( (a+1) % (int)boundaryN == b )
+        forward++;
+      else
+        backward++;
+
+      if ( rn > 0 && a < b )
+        check.nonManifold_++;
+    }
+    else if ( rn == 0 )
+      check.open_++;
+  }
+
+  for (size_t i = 0; i < boundaryN; ++i)
+  {
+    int a = (int)i, b = (int)((i+1) % boundaryN);
+    if ( edges.find(Edge(a, b)) == edges.end() && edges.find(Edge(b, a)) == edges.end() )
+      check.boundaryMissing_++;
+  }
+
+  check.boundaryFlipped_ = std::min(forward, backward);
+  std::vector< std::pair<int, int> > pairs;
+  findSelfIntersections(verts, tris, pairs);
+  check.selfIntersections_ = pairs.size();
+  checkBoundaryMoved(boundary, verts, check);
+}
+
+void iMesh::writeCheck(std::ostream & os, const MeshCheck & check)
+{
+  if ( check.valid() )
+  {
+    os << "valid";
+    return;
+  }
+
+  const char * sep = "";
+  if ( check.degenerate_ )
+  {
+    os << sep << check.degenerate_ << " degenerate triangles";
+    sep = ", ";
+  }
+  if ( check.nonManifold_ )
+  {
+    os << sep << check.nonManifold_ << " non-manifold edges";
+    sep = ", ";
+  }
+  if ( check.open_ )
+  {
+    os << sep << check.open_ << " open inner edges";
+    sep = ", ";
+  }
+  if ( check.boundaryMissing_ )
+  {
+    os << sep << check.boundaryMissing_ << " boundary edges missing";
+    sep = ", ";
+  }
+  if ( check.boundaryFlipped_ )
+  {
+    os << sep << check.boundaryFlipped_ << " boundary edges flipped";
+    sep = ", ";
+  }
+  if ( check.selfIntersections_ )
+  {
+    os << sep << check.selfIntersections_ << " self-intersections";
+    sep = ", ";
+  }
+  if ( check.boundaryMoved_ )
+    os << sep << check.boundaryMoved_ << " boundary vertices moved, up to " << check.boundaryShift_;
+}
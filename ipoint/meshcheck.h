@@ -0,0 +1,48 @@
+#pragma once
+
+#include <iosfwd>
+#include <vector>
+#include <utility>
+#include "vec.h"
+
+// problems found in triangulated hole, see iMesh::checkMesh
+struct MeshCheck
+{
+  MeshCheck();
+
+  bool valid() const;
+
+  // triangles with repeated vertex or without area
+  size_t degenerate_;
+
+  // edges used twice in one direction or by more than two triangles
+  size_t nonManifold_;
+
+  // inner edges used by one triangle only
+  size_t open_;
+
+  // boundary edges not used by any triangle, used in the minority direction
+  size_t boundaryMissing_;
+  size_t boundaryFlipped_;
+
+  // pairs of triangles without common vertices intersecting each other
+  size_t selfIntersections_;
+
+  // boundary vertices moved away from their input positions, and the largest move
+  size_t boundaryMoved_;
+  double boundaryShift_;
+};
+
+namespace iMesh
+{
+
+// first boundary.size() vertices are expected to be the closed boundary loop, at the positions
+// of boundary. a move further than 1e-9 of the boundary's diagonal counts as boundaryMoved_
+void checkMesh(const Vertices & boundary, const Vertices & verts, const Triangles & tris, MeshCheck & check);
+
+// pairs of triangles without common vertices intersecting each other, as indices in tris, smaller first
+void findSelfIntersections(const Vertices & verts, const Triangles & tris, std::vector< std::pair<int, int> > & pairs);
+
+void writeCheck(std::ostream & os, const MeshCheck & check);
+
+}
@@ -0,0 +1,107 @@
+#include "meshio.h"
+#include <istream>
+#include <ostream>
+#include <sstream>
+#include <string>
+
+bool iMeshIO::readBoundary(std::istream & is, Vertices & verts)
+{
+  verts.clear();
+
+  std::string sline;
+  bool opened = false;
+  for ( ; std::getline(is, sline); )
+  {
+    if ( sline.empty() )
+      continue;
+
+    if ( sline[0] == '{' )
+    {
+      opened = true;
+      continue;
+    }
+
+    if ( !opened )
+      continue;
+
+    if ( sline[0] == '}' )
+      break;
+
+    for (std::string::iterator i = sline.begin(); i != sline.end(); ++i)
+    {
+      if ( *i == '{' || *i == '}' || *i == ',' || *i == ';' )
+        *i = ' ';
+    }
+
+    std::istringstream iss(sline);
+    double v[6];
+    int n = 0;
+    for ( ; n < 6 && (iss >> v[n]); ++n);
+
+    if ( n < 2 )
+      break;
+
+    Vec3f p(v[0], v[1], 0), nor(0, 0, 1);
+
+    if ( n > 2 )
+      p.z = v[2];
+
+    if ( n > 5 )
+      nor.set(v[3], v[4], v[5]);
+
+    verts.push_back( Vertex(p, nor) );
+  }
+
+  return opened;
+}
+
+void iMeshIO::writeBoundary(std::ostream & os, const Vertices & verts)
+{
+  os << "{\n";
+
+  for (Vertices::const_iterator i = verts.begin(); i != verts.end(); ++i)
+  {
+    const Vec3f & p = i->p();
+    const Vec3f & n = i->n();
+    os << "  {" << p.x << ", " << p.y << ", " << p.z << "} {" << n.x << ", " << n.y << ", " << n.z << "}\n";
+  }
+
+  os << "}\n";
+}
+
+void iMeshIO::writeMesh(std::ostream & os, const char * meshName, const Vertices & verts, const Triangles & tris)
+{
+  Vec3f color(0,1,0);
+
+  os << "Mesh \"" << (meshName ? meshName : "Mesh") << "\" {\n";
+
+  os << "  Wireframe {\n";
+  os << "    ( true )\n";
+  os << "  }\n";
+
+  os << "  Shaded {\n";
+  os << "    ( true )\n";
+  os << "  }\n";
+
+  os << "  DefaultColor {\n";
+  os << "    ( " << color.x << ", " << color.y << ", " << color.z << " )\n";
+  os << "  }\n";
+
+  os << "  Coords {\n";
+  for (Vertices::const_iterator i = verts.begin(); i != verts.end(); ++i)
+  {
+    const Vec3f & p = i->p();
+    os << "    ( " << p.x << ", " << p.y << ", " << p.z << " )\n";
+  }
+  os << "  }\n";
+
+  os << "  Faces {\n";
+  for (Triangles::const_iterator i = tris.begin(); i != tris.end(); ++i)
+  {
+    const Triangle & t = *i;
+    os << "    ( " << t.x << ", " << t.y << ", " << t.z << " )\n";
+  }
+  os << "  }\n";
+
+  os << "}\n";
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <iosfwd>
+#include "vec.h"
+
+namespace iMeshIO
+{
+
+// reads next "{ ... }" boundary block, one "{x, y[, z]} [{nx, ny, nz}]" point per line
+// returns false if there are no more blocks in stream
+bool readBoundary(std::istream & is, Vertices & verts);
+
+void writeBoundary(std::ostream & os, const Vertices & verts);
+
+void writeMesh(std::ostream & os, const char * meshName, const Vertices & verts, const Triangles & tris);
+
+}
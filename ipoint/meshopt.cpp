@@ -0,0 +1,225 @@
+#include "meshopt.h"
+#include <math.h>
+#include <algorithm>
+
+namespace
+{
+  const int maxCacheSize = 64;
+
+  struct VertexInfo
+  {
+    VertexInfo() : cachePos_(-1), score_(0), activeN_(0), first_(0) {}
+
+    int cachePos_;
+    double score_;
+    int activeN_;
+    int first_;
+  };
+
+  double vertexScore(const VertexInfo & v, int cacheSize)
+  {
+    if ( v.activeN_ == 0 )
+      return -1.0;
+
+    double score = 0;
+    if ( v.cachePos_ >= 0 )
+    {
+      // the last triangle's vertices are used anyway, don't prefer them too much
+      if ( v.cachePos_ < 3 )
+        score = 0.75;
+      else
+        score = pow(1.0 - double(v.cachePos_ - 3) / (cacheSize - 3), 1.5);
+    }
+
+    // prefer to finish vertices with few triangles left
+    score += 2.0 / sqrt((double)v.activeN_);
+    return score;
+  }
+}
+
+void iMesh::optimizeVertexCache(Triangles & tris, size_t vertsN, int cacheSize)
+{
+  if ( tris.empty() || vertsN == 0 )
+    return;
+
+  cacheSize = std::max(4, std::min(cacheSize, maxCacheSize - 3));
+
+  std::vector<VertexInfo> verts(vertsN);
+  for (size_t i = 0; i < tris.size(); ++i)
+  {
+    for (int j = 0; j < 3; ++j)
+      verts[tris[i].v[j]].activeN_++;
+  }
+
+  // vertex -> triangles adjacency
+  std::vector<int> vtris(tris.size()*3);
+  for (size_t i = 0, first = 0; i < vertsN; ++i)
+  {
+    verts[i].first_ = (int)first;
+    first += verts[i].activeN_;
+    verts[i].score_ = vertexScore(verts[i], cacheSize);
+  }
+
+  std::vector<int> filled(vertsN, 0);
+  for (size_t i = 0; i < tris.size(); ++i)
+  {
+    for (int j = 0; j < 3; ++j)
+    {
+      int v = tris[i].v[j];
+      vtris[verts[v].first_ + filled[v]++] = (int)i;
+    }
+  }
+
+  std::vector<double> tscores(tris.size());
+  std::vector<char> added(tris.size(), 0);
+  for (size_t i = 0; i < tris.size(); ++i)
+    tscores[i] = verts[tris[i].x].score_ + verts[tris[i].y].score_ + verts[tris[i].z].score_;
+
+  Triangles result;
+  result.reserve(tris.size());
+
+  // LRU cache, extra 3 entries for vertices pushed out by the last triangle
+  int cache[maxCacheSize], cacheN = 0;
+  int best = -1;
+  size_t scanFrom = 0;
+
+  for ( ; result.size() < tris.size(); )
+  {
+    if ( best < 0 )
+    {
+      // nothing in cache is useful, take the best of remaining triangles
+      double bestScore = -1;
+      for ( ; scanFrom < tris.size() && added[scanFrom]; ++scanFrom);
+      for (size_t i = scanFrom; i < tris.size(); ++i)
+      {
+        if ( !added[i] && tscores[i] > bestScore )
+        {
+          bestScore = tscores[i];
+          best = (int)i;
+        }
+      }
+    }
+
+    const Triangle & t = tris[best];
+    result.push_back(t);
+    added[best] = 1;
+
+    int newCache[maxCacheSize], newN = 0;
+    for (int j = 0; j < 3; ++j)
+    {
+      int v = t.v[j];
+      newCache[newN++] = v;
+
+      // remove triangle from vertex's active list
+      VertexInfo & vi = verts[v];
+      int * first = &vtris[vi.first_];
+      int * last = first + vi.activeN_;
+      int * iter = std::find(first, last, best);
+      if ( iter != last )
+      {
+        std::swap(*iter, *(last-1));
+        vi.activeN_--;
+      }
+    }
+
+    for (int i = 0; i < cacheN; ++i)
+    {
+      int v = cache[i];
+      if ( v != t.x && v != t.y && v != t.z && newN < cacheSize+3 )
+        newCache[newN++] = v;
+    }
+
+    for (int i = 0; i < cacheN; ++i)
+      verts[cache[i]].cachePos_ = -1;
+
+    cacheN = std::min(newN, cacheSize+3);
+    for (int i = 0; i < cacheN; ++i)
+    {
+      cache[i] = newCache[i];
+      VertexInfo & vi = verts[cache[i]];
+      vi.cachePos_ = i < cacheSize ? i : -1;
+      double delta = vertexScore(vi, cacheSize) - vi.score_;
+      vi.score_ += delta;
+      for (int k = 0; k < vi.activeN_; ++k)
+        tscores[vtris[vi.first_ + k]] += delta;
+    }
+
+    best = -1;
+    double bestScore = -1;
+    for (int i = 0; i < cacheN; ++i)
+    {
+      const VertexInfo & vi = verts[cache[i]];
+      for (int k = 0; k < vi.activeN_; ++k)
+      {
+        int ti = vtris[vi.first_ + k];
+        if ( tscores[ti] > bestScore )
+        {
+          bestScore = tscores[ti];
+          best = ti;
+        }
+      }
+    }
+
+    // vertices pushed out of the cache
+    if ( cacheN > cacheSize )
+      cacheN = cacheSize;
+  }
+
+  tris.swap(result);
+}
+
+void iMesh::optimizeVertexFetch(Vertices & verts, Triangles & tris, size_t first, std::vector<int> & remap)
+{
+  remap.resize(verts.size());
+  for (size_t i = 0; i < remap.size(); ++i)
+    remap[i] = i < first ? (int)i : -1;
+
+  int next = (int)first;
+  for (Triangles::iterator i = tris.begin(); i != tris.end(); ++i)
+  {
+    for (int j = 0; j < 3; ++j)
+    {
+      int & index = remap[i->v[j]];
+      if ( index < 0 )
+        index = next++;
+      i->v[j] = index;
+    }
+  }
+
+  // unused vertices go to the end
+  for (size_t i = first; i < remap.size(); ++i)
+  {
+    if ( remap[i] < 0 )
+      remap[i] = next++;
+  }
+
+  Vertices result(verts.size());
+  for (size_t i = 0; i < verts.size(); ++i)
+    result[remap[i]] = verts[i];
+
+  verts.swap(result);
+}
+
+double iMesh::cacheMissRatio(const Triangles & tris, size_t vertsN, int cacheSize)
+{
+  if ( tris.empty() )
+    return 0;
+
+  // FIFO cache, a vertex is in cache if it was pushed less than cacheSize misses ago
+  std::vector<size_t> stamps(vertsN, 0);
+  size_t misses = 0;
+  for (Triangles::const_iterator i = tris.begin(); i != tris.end(); ++i)
+  {
+    for (int j = 0; j < 3; ++j)
+    {
+      size_t & stamp = stamps[i->v[j]];
+      if ( stamp == 0 || misses - stamp >= (size_t)cacheSize )
+      {
+        misses++;
+        stamp = misses;
+      }
+    }
+  }
+
+  return double(misses) / tris.size();
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "vec.h"
+
+namespace iMesh
+{
+
+// reorders triangles for post-transform vertex cache of given size (Forsyth's linear-speed algorithm)
+void optimizeVertexCache(Triangles & tris, size_t vertsN, int cacheSize = 32);
+
+// renumbers vertices [first, verts.size()) in order of their first use by triangles
+// vertices below 'first' keep their indices. remap[old index] = new index
+void optimizeVertexFetch(Vertices & verts, Triangles & tris, size_t first, std::vector<int> & remap);
+
+// average cache miss ratio (transformed vertices per triangle) for FIFO cache of given size
+double cacheMissRatio(const Triangles & tris, size_t vertsN, int cacheSize);
+
+}
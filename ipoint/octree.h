@@ -4,6 +4,7 @@
 #include <list>
 #include <algorithm>
 #include "rect.h"
+#include "tristats.h"
 
 template <class T>
 class OcTree
@@ -38,9 +39,13 @@ class OcTree
   boost::shared_ptr<Node> root_;
   const Vec3f scale_percent_;
 
+  // calls statistics
+  size_t addsN_, removesN_, collectsN_, collectedN_;
+
 public:
 
-  OcTree(Rect3f & rc, int depth) : rect_(rc), depth_(depth), scale_percent_(1.05, 1.05, 1.05)
+  OcTree(Rect3f & rc, int depth) : rect_(rc), depth_(depth), scale_percent_(1.05, 1.05, 1.05),
+    addsN_(0), removesN_(0), collectsN_(0), collectedN_(0)
   {
     rect_.scale( scale_percent_ );
     root_.reset( new Node(rect_, 0) );
@@ -48,29 +53,94 @@ public:
 
   void add(const T * t)
   {
+    addsN_++;
     splitNode(root_.get(), t);
   }
 
   void remove(const T * t)
   {
+    removesN_++;
     remove(root_.get(), t);
   }
 
+  // drops all items, calls statistics are kept
+  void clear()
+  {
+    root_.reset( new Node(rect_, 0) );
+  }
+
   void collect(const Rect3f & rc, std::set<const T*> & items)
+  {
+    size_t n = items.size();
+    find(rc, items);
+    countCollect(items.size() - n);
+  }
+
+  // the same as collect, but not counted. safe for concurrent readers
+  void find(const Rect3f & rc, std::set<const T*> & items) const
   {
     search(root_.get(), rc, items);
   }
 
+  // counts a collect done by find
+  void countCollect(size_t found)
+  {
+    collectsN_++;
+    collectedN_ += found;
+  }
+
+  size_t addsCount() const { return addsN_; }
+  size_t removesCount() const { return removesN_; }
+  size_t collectsCount() const { return collectsN_; }
+
+  // number of items returned by collect
+  size_t collectedCount() const { return collectedN_; }
+
+  // walks the whole tree, not for use in hot paths
+  void diagnostics(OcTreeDiagnostics & diag) const
+  {
+    diag.clear();
+    std::set<const T*> items;
+    diagnostics(root_.get(), diag, items);
+    diag.items_ = items.size();
+  }
+
 private:
 
-  void search(Node * node, const Rect3f & rc, std::set<const T*> & items)
+  void diagnostics(const Node * node, OcTreeDiagnostics & diag, std::set<const T*> & items) const
+  {
+    if ( !node )
+      return;
+
+    if ( diag.nodesPerLevel_.size() <= (size_t)node->level_ )
+      diag.nodesPerLevel_.resize(node->level_+1, 0);
+    diag.nodesPerLevel_[node->level_]++;
+
+    if ( node->level_ >= depth_ )
+    {
+      size_t n = node->array_.size(), bucket = 0;
+      for ( ; n > 0; n >>= 1, ++bucket);
+      if ( diag.leafOccupancy_.size() <= bucket )
+        diag.leafOccupancy_.resize(bucket+1, 0);
+      diag.leafOccupancy_[bucket]++;
+
+      diag.references_ += node->array_.size();
+      items.insert(node->array_.begin(), node->array_.end());
+      return;
+    }
+
+    for (int i = 0; i < 8; ++i)
+      diagnostics(node->children_[i].get(), diag, items);
+  }
+
+  void search(const Node * node, const Rect3f & rc, std::set<const T*> & items) const
   {
     if ( !node || !node->intersect(rc) )
       return;
 
     if ( node->level_ >= depth_ )
     {
-      for (typename std::list<const T*>::iterator i = node->array_.begin(); i != node->array_.end(); ++i)
+      for (typename std::list<const T*>::const_iterator i = node->array_.begin(); i != node->array_.end(); ++i)
         items.insert(*i);
 
       return;
@@ -1,12 +1,13 @@
 #include "oredge.h"
+#include <iterator>
 
 OrEdge::OrEdge(EdgesContainer * container) :
-  org_(-1), dst_(-1), container_(container), next_(0), adjacent_(0)
+  org_(-1), dst_(-1), id_(-1), container_(container), next_(0), adjacent_(0)
 {
 }
 
-OrEdge::OrEdge(int o, int d, EdgesContainer * container) :
-  org_(o), dst_(d), container_(container), next_(0), adjacent_(0)
+OrEdge::OrEdge(int o, int d, EdgesContainer * container, int id) :
+  org_(o), dst_(d), id_(id), container_(container), next_(0), adjacent_(0)
 {
 }
 
@@ -330,6 +331,12 @@ Triangle OrEdge::tri() const
   return Triangle(org(), next()->dst(), dst());
 }
 
+void OrEdge::renumber(const std::vector<int> & remap)
+{
+  org_ = remap.at(org_);
+  dst_ = remap.at(dst_);
+}
+
 double OrEdge::length() const
 {
   return (container_->verts().at(org()).p() - container_->verts().at(dst()).p()).length();
@@ -353,7 +360,41 @@ Rect3f OrEdge::rect() const
 //////////////////////////////////////////////////////////////////////////
 OrEdge * EdgesContainer::new_edge(int o, int d)
 {
-  OrEdge_shared edge(new OrEdge(o, d, this));
+  OrEdge_shared edge(new OrEdge(o, d, this, (int)edges_.size()));
   edges_.push_back(edge);
   return edge.get();
 }
+
+namespace
+{
+  bool endsLess(const OrEdge_shared & a, const OrEdge_shared & b)
+  {
+    if ( a->org() != b->org() )
+      return a->org() < b->org();
+    return a->dst() < b->dst();
+  }
+}
+
+void EdgesContainer::sortEdges(size_t n)
+{
+  if ( n >= edges_.size() )
+    return;
+
+  OrEdgesList_shared::iterator from = edges_.begin();
+  std::advance(from, n);
+
+  OrEdgesList_shared tail;
+  tail.splice(tail.begin(), edges_, from, edges_.end());
+  tail.sort(endsLess);
+  edges_.splice(edges_.end(), tail);
+
+  int id = 0;
+  for (OrEdgesList_shared::iterator i = edges_.begin(); i != edges_.end(); ++i)
+    (*i)->id_ = id++;
+}
+
+void EdgesContainer::renumber(const std::vector<int> & remap)
+{
+  for (OrEdgesList_shared::iterator i = edges_.begin(); i != edges_.end(); ++i)
+    (*i)->renumber(remap);
+}
@@ -31,13 +31,16 @@ class OrEdge
 public:
 
   OrEdge(EdgesContainer * container);
-  OrEdge(int o, int d, EdgesContainer * container);
+  OrEdge(int o, int d, EdgesContainer * container, int id = -1);
 
 
   // structure
   int org() const { return org_; }
   int dst() const { return dst_; }
 
+  // sequential number in container, -1 for temporary edges
+  int id() const { return id_; }
+
   // topology
   OrEdge * get_adjacent();
   const OrEdge * get_adjacent() const;
@@ -63,6 +66,9 @@ public:
   // get triangle representation
   Triangle tri() const;
 
+  // org = remap[org], dst = remap[dst]
+  void renumber(const std::vector<int> & remap);
+
   // geometry
   double length() const;
   Vec3f  dir() const;
@@ -71,11 +77,13 @@ public:
   // data
 private:
 
+  friend class EdgesContainer;
+
   void verifyTopology(std::set<const OrEdge*> & verified) const;
 
   const OrEdge * findConnection() const;
 
-  int org_, dst_;
+  int org_, dst_, id_;
   OrEdge * next_, * adjacent_;
   EdgesContainer * container_;
 };
@@ -85,6 +93,15 @@ inline bool intersect(const Rect3f & rc, const OrEdge & e)
   return rc.intersecting(e.rect());
 }
 
+// orders edges by creation, so iterating over a set doesn't depend on memory layout
+struct OrEdgeLess
+{
+  bool operator () (const OrEdge * a, const OrEdge * b) const
+  {
+    return a->id() < b->id();
+  }
+};
+
 typedef boost::shared_ptr<OrEdge> OrEdge_shared;
 typedef std::list<OrEdge_shared> OrEdgesList_shared;
 
@@ -97,6 +114,13 @@ public:
 
   OrEdge * new_edge(int o, int d);
 
+  // apply new vertices numbering to all edges
+  void renumber(const std::vector<int> & remap);
+
+  // edges created after the first n ones are ordered by their ends and get new ids,
+  // so the order doesn't depend on which thread created them
+  void sortEdges(size_t n);
+
   Vertices & verts()
   {
     return verts_;
@@ -0,0 +1,128 @@
+#include "perfcounters.h"
+
+PerfSample PerfReading::operator - (const PerfReading & other) const
+{
+  PerfSample r;
+  for (int i = 0; i < PerfSample::CountersN; ++i)
+  {
+    if ( values_[i] < 0 || other.values_[i] < 0 )
+      continue;
+
+    long long value = values_[i] - other.values_[i];
+    long long enabled = enabled_[i] - other.enabled_[i];
+    long long running = running_[i] - other.running_[i];
+
+    // scale if counters were multiplexed
+    if ( running > 0 && running < enabled )
+      value = (long long)(double(value) * enabled / running);
+
+    r.values_[i] = value;
+  }
+  return r;
+}
+
+#ifdef __linux__
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <string.h>
+
+namespace
+{
+  int openCounter(unsigned type, unsigned long long config)
+  {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    // threads created later are summed into the values read
+    attr.inherit = 1;
+
+    // this thread on any cpu
+    return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+  }
+
+  unsigned long long cacheMiss(unsigned long long cache)
+  {
+    return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+  }
+}
+
+PerfCounters::PerfCounters()
+{
+  fds_[PerfSample::Cycles] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+  fds_[PerfSample::Instructions] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+  fds_[PerfSample::L1Misses] = openCounter(PERF_TYPE_HW_CACHE, cacheMiss(PERF_COUNT_HW_CACHE_L1D));
+  fds_[PerfSample::LLCMisses] = openCounter(PERF_TYPE_HW_CACHE, cacheMiss(PERF_COUNT_HW_CACHE_LL));
+  fds_[PerfSample::BranchMisses] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+}
+
+PerfCounters::~PerfCounters()
+{
+  for (int i = 0; i < PerfSample::CountersN; ++i)
+  {
+    if ( fds_[i] >= 0 )
+      close(fds_[i]);
+  }
+}
+
+bool PerfCounters::available() const
+{
+  for (int i = 0; i < PerfSample::CountersN; ++i)
+  {
+    if ( fds_[i] >= 0 )
+      return true;
+  }
+  return false;
+}
+
+PerfReading PerfCounters::read() const
+{
+  PerfReading reading;
+  for (int i = 0; i < PerfSample::CountersN; ++i)
+  {
+    if ( fds_[i] < 0 )
+      continue;
+
+    // value, time enabled, time running
+    unsigned long long data[3];
+    if ( ::read(fds_[i], data, sizeof(data)) != sizeof(data) )
+      continue;
+
+    reading.values_[i] = (long long)data[0];
+    reading.enabled_[i] = (long long)data[1];
+    reading.running_[i] = (long long)data[2];
+  }
+  return reading;
+}
+
+#else
+
+PerfCounters::PerfCounters()
+{
+  for (int i = 0; i < PerfSample::CountersN; ++i)
+    fds_[i] = -1;
+}
+
+PerfCounters::~PerfCounters()
+{
+}
+
+bool PerfCounters::available() const
+{
+  return false;
+}
+
+PerfReading PerfCounters::read() const
+{
+  return PerfReading();
+}
+
+#endif
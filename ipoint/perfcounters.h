@@ -0,0 +1,87 @@
+#pragma once
+
+// hardware counters values, -1 if counter is unavailable
+struct PerfSample
+{
+  enum { Cycles, Instructions, L1Misses, LLCMisses, BranchMisses, CountersN };
+
+  PerfSample()
+  {
+    for (int i = 0; i < CountersN; ++i)
+      values_[i] = -1;
+  }
+
+  long long operator [] (int i) const { return values_[i]; }
+
+  // this - other, -1 if any is unavailable
+  PerfSample operator - (const PerfSample & other) const
+  {
+    PerfSample r;
+    for (int i = 0; i < CountersN; ++i)
+      r.values_[i] = values_[i] >= 0 && other.values_[i] >= 0 ? values_[i] - other.values_[i] : -1;
+    return r;
+  }
+
+  PerfSample & operator += (const PerfSample & other)
+  {
+    for (int i = 0; i < CountersN; ++i)
+      values_[i] = values_[i] >= 0 && other.values_[i] >= 0 ? values_[i] + other.values_[i] : -1;
+    return *this;
+  }
+
+  bool valid() const
+  {
+    for (int i = 0; i < CountersN; ++i)
+    {
+      if ( values_[i] >= 0 )
+        return true;
+    }
+    return false;
+  }
+
+  long long values_[CountersN];
+};
+
+// raw counts with times the counters were enabled and running, -1 if counter is unavailable
+struct PerfReading
+{
+  PerfReading()
+  {
+    for (int i = 0; i < PerfSample::CountersN; ++i)
+      values_[i] = enabled_[i] = running_[i] = -1;
+  }
+
+  // counts between other and this, scaled by the part of that time counters were running
+  PerfSample operator - (const PerfReading & other) const;
+
+  long long values_[PerfSample::CountersN];
+  long long enabled_[PerfSample::CountersN];
+  long long running_[PerfSample::CountersN];
+};
+
+/**
+  Hardware performance counters of the calling thread (perf_event_open on Linux)
+
+  Threads created by the calling thread after the counters are opened, e.g. TaskPool
+  workers, are counted too. Counters that can't be opened, e.g. in containers or
+  on other platforms, read as -1.
+*/
+class PerfCounters
+{
+public:
+
+  PerfCounters();
+  ~PerfCounters();
+
+  // true if at least one counter is opened
+  bool available() const;
+
+  PerfReading read() const;
+
+private:
+
+  PerfCounters(const PerfCounters & );
+  PerfCounters & operator = (const PerfCounters & );
+
+  int fds_[PerfSample::CountersN];
+};
@@ -0,0 +1,201 @@
+#include "pipeline.h"
+#include "meshio.h"
+#include "iprofile.h"
+#include <fstream>
+#include <sstream>
+#include <boost/thread/thread.hpp>
+#include <boost/bind/bind.hpp>
+
+BoundaryReader::BoundaryReader(const std::vector<std::string> & fnames) :
+  fnames_(fnames), fileIndex_(0), holeIndex_(0)
+{
+}
+
+bool BoundaryReader::next(BoundaryHole & hole)
+{
+  for ( ;; )
+  {
+    if ( !is_ )
+    {
+      if ( fileIndex_ >= fnames_.size() )
+        return false;
+
+      is_.reset( new std::ifstream(fnames_[fileIndex_].c_str()) );
+      holeIndex_ = 0;
+    }
+
+    if ( *is_ && iMeshIO::readBoundary(*is_, hole.verts_) )
+    {
+      hole.source_ = fnames_[fileIndex_];
+      hole.index_ = holeIndex_++;
+      return true;
+    }
+
+    is_.reset();
+    fileIndex_++;
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+MeshWriter::MeshWriter(std::ostream & os) : os_(os)
+{
+}
+
+void MeshWriter::write(const BoundaryHole & hole, const Triangles & tris)
+{
+  std::ostringstream oss;
+  oss << hole.source_ << "#" << hole.index_;
+  iMeshIO::writeMesh(os_, oss.str().c_str(), hole.verts_, tris);
+}
+
+//////////////////////////////////////////////////////////////////////////
+TriangulationPipeline::TriangulationPipeline(size_t threadsN, size_t inFlightMax, const TriangulationOptions & options) :
+  threadsN_(threadsN), inFlightMax_(inFlightMax), options_(options),
+  reader_(0), writer_(0), log_(0), stats_(0),
+  inFlight_(0), readN_(0), writtenN_(0), eof_(false),
+  holesN_(0), failedN_(0), trianglesN_(0)
+{
+  if ( threadsN_ < 1 )
+    threadsN_ = 1;
+
+  if ( inFlightMax_ < 1 )
+    inFlightMax_ = 1;
+}
+
+void TriangulationPipeline::run(BoundaryReader & reader, MeshWriter & writer, std::ostream * log, std::ostream * stats)
+{
+  reader_ = &reader;
+  writer_ = &writer;
+  log_ = log;
+  stats_ = stats;
+
+  inFlight_ = readN_ = writtenN_ = 0;
+  holesN_ = failedN_ = trianglesN_ = 0;
+  eof_ = false;
+  ready_.clear();
+
+  if ( threadsN_ == 1 )
+  {
+    worker(0);
+  }
+  else
+  {
+    boost::thread_group workers;
+    for (size_t i = 0; i < threadsN_; ++i)
+      workers.create_thread( boost::bind(&TriangulationPipeline::worker, this, i) );
+    workers.join_all();
+  }
+
+  reader_ = 0;
+  writer_ = 0;
+  log_ = 0;
+  stats_ = 0;
+}
+
+void TriangulationPipeline::worker(size_t index)
+{
+  std::ostringstream name;
+  name << "worker " << index;
+  iProfile::setThreadName(name.str());
+
+  for ( ;; )
+  {
+    Item_shared item = acquire();
+    if ( !item )
+      break;
+
+    TRACE_SCOPE("hole");
+    TRACE_ARG("source", item->hole_.source_);
+    TRACE_ARG("points", (double)item->hole_.verts_.size());
+
+    try
+    {
+      DelaunayTriangulator dtr(item->hole_.verts_, options_);
+      dtr.triangulate(item->tris_);
+      item->stats_ = dtr.stats();
+      item->ok_ = true;
+    }
+    catch ( std::exception & e )
+    {
+      item->tris_.clear();
+      item->error_ = e.what();
+      item->ok_ = false;
+    }
+
+    release(item);
+  }
+}
+
+TriangulationPipeline::Item_shared TriangulationPipeline::acquire()
+{
+  boost::mutex::scoped_lock lock(mutex_);
+
+  while ( !eof_ && inFlight_ >= inFlightMax_ )
+    slotFreed_.wait(lock);
+
+  if ( eof_ )
+    return Item_shared();
+
+  Item_shared item(new Item);
+  if ( !reader_->next(item->hole_) )
+  {
+    eof_ = true;
+    slotFreed_.notify_all();
+    return Item_shared();
+  }
+
+  item->seq_ = readN_++;
+  item->ok_ = false;
+  inFlight_++;
+
+  return item;
+}
+
+void TriangulationPipeline::release(Item_shared item)
+{
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    ready_[item->seq_] = item;
+  }
+
+  // whoever gets here first writes all the holes ready in input order
+  boost::mutex::scoped_lock wlock(writeMutex_);
+
+  for ( ;; )
+  {
+    Item_shared head;
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      std::map<size_t, Item_shared>::iterator i = ready_.find(writtenN_);
+      if ( i == ready_.end() )
+        break;
+
+      head = i->second;
+      ready_.erase(i);
+    }
+
+    if ( head->ok_ )
+      writer_->write(head->hole_, head->tris_);
+    else if ( log_ )
+      *log_ << head->hole_.source_ << "#" << head->hole_.index_ << ": " << head->error_ << "\n";
+
+    if ( head->ok_ && stats_ )
+    {
+      *stats_ << head->hole_.source_ << "#" << head->hole_.index_ << ":\n";
+      writeStats(*stats_, head->stats_);
+    }
+
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      writtenN_++;
+      inFlight_--;
+      holesN_++;
+      if ( head->ok_ )
+        trianglesN_ += head->tris_.size();
+      else
+        failedN_++;
+    }
+
+    slotFreed_.notify_one();
+  }
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <iosfwd>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include "delaunay.h"
+
+struct BoundaryHole
+{
+  BoundaryHole() : index_(0) {}
+
+  std::string source_;
+  size_t index_;
+  Vertices verts_;
+};
+
+// reads holes one by one from the list of boundary files
+class BoundaryReader
+{
+public:
+
+  BoundaryReader(const std::vector<std::string> & fnames);
+
+  // returns false if all files are read
+  bool next(BoundaryHole & hole);
+
+private:
+
+  std::vector<std::string> fnames_;
+  size_t fileIndex_, holeIndex_;
+  boost::shared_ptr<std::istream> is_;
+};
+
+// writes triangulated holes as meshes in save3d format
+class MeshWriter
+{
+public:
+
+  MeshWriter(std::ostream & os);
+
+  void write(const BoundaryHole & hole, const Triangles & tris);
+
+private:
+
+  std::ostream & os_;
+};
+
+/**
+  read -> triangulate -> write pipeline
+
+  Holes are read lazily, triangulated by threadsN workers and written in input order.
+  No more than inFlightMax holes are kept in memory at once, including the ones
+  already triangulated but waiting for the previous holes to be written.
+*/
+class TriangulationPipeline
+{
+  struct Item
+  {
+    BoundaryHole hole_;
+    Triangles tris_;
+    TriangulationStats stats_;
+    std::string error_;
+    size_t seq_;
+    bool ok_;
+  };
+
+  typedef boost::shared_ptr<Item> Item_shared;
+
+public:
+
+  TriangulationPipeline(size_t threadsN, size_t inFlightMax, const TriangulationOptions & options = TriangulationOptions());
+
+  // failed holes are skipped, the reason is written to log if given
+  // per hole statistics are written to stats if given
+  void run(BoundaryReader & reader, MeshWriter & writer, std::ostream * log = 0, std::ostream * stats = 0);
+
+  size_t holesCount() const { return holesN_; }
+  size_t failedCount() const { return failedN_; }
+  size_t trianglesCount() const { return trianglesN_; }
+
+private:
+
+  void worker(size_t index);
+  Item_shared acquire();
+  void release(Item_shared item);
+
+  size_t threadsN_;
+  size_t inFlightMax_;
+  TriangulationOptions options_;
+
+  BoundaryReader * reader_;
+  MeshWriter * writer_;
+  std::ostream * log_;
+  std::ostream * stats_;
+
+  boost::mutex mutex_, writeMutex_;
+  boost::condition_variable slotFreed_;
+  size_t inFlight_;
+  size_t readN_, writtenN_;
+  bool eof_;
+  std::map<size_t, Item_shared> ready_;
+
+  size_t holesN_, failedN_, trianglesN_;
+};
@@ -0,0 +1,584 @@
+#include "planar.h"
+#include "imath.h"
+#include <math.h>
+#include <map>
+#include <set>
+#include <algorithm>
+
+void iPlanar::PlaneFrame::set(const Vec3f & origin, const Vec3f & n)
+{
+  origin_ = origin;
+  n_ = n;
+
+  // any direction not parallel to n, u x v = n
+  Vec3f a = fabs(n.x) < 0.6 ? Vec3f(1, 0, 0) : Vec3f(0, 1, 0);
+  u_ = a ^ n;
+  u_.normalize();
+  v_ = n ^ u_;
+}
+
+Vec3f iPlanar::PlaneFrame::project(const Vec3f & p) const
+{
+  Vec3f d = p - origin_;
+  return Vec3f(d*u_, d*v_, d*n_);
+}
+
+bool iPlanar::planarFrame(const Vertices & verts, double tolerance, PlaneFrame & frame)
+{
+  if ( verts.size() < 3 || verts[0].n().length() < iMath::err )
+    return false;
+
+  Vec3f n0 = verts[0].n();
+  n0.normalize();
+
+  Rect3f rect;
+  for (Vertices::const_iterator i = verts.begin(); i != verts.end(); ++i)
+  {
+    Vec3f n = i->n();
+    if ( n.length() < iMath::err || (n.normalize() - n0).length() > 1e-6 )
+      return false;
+
+    rect.add(i->p());
+  }
+
+  frame.set(verts[0].p(), n0);
+
+  double maxDist = tolerance * rect.diagonal().length();
+  for (Vertices::const_iterator i = verts.begin(); i != verts.end(); ++i)
+  {
+    if ( fabs((i->p() - frame.origin_)*n0) > maxDist )
+      return false;
+  }
+
+  return true;
+}
+
+bool iPlanar::fitFrame(const Vertices & verts, PlaneFrame & frame)
+{
+  if ( verts.size() < 3 )
+    return false;
+
+  Vec3f origin, n;
+  for (Vertices::const_iterator i = verts.begin(); i != verts.end(); ++i)
+  {
+    origin += i->p();
+    n += i->n();
+  }
+
+  if ( n.length() < iMath::err )
+    return false;
+
+  n.normalize();
+
+  frame.set(origin * (1.0/verts.size()), n);
+  return true;
+}
+
+bool iPlanar::areaFrame(const Vertices & verts, PlaneFrame & frame)
+{
+  if ( verts.size() < 3 )
+    return false;
+
+  Vec3f origin, n;
+  for (size_t i = 0; i < verts.size(); ++i)
+  {
+    const Vec3f & a = verts[i].p();
+    const Vec3f & b = verts[(i+1) % verts.size()].p();
+    origin += a;
+    n += a ^ b;
+  }
+
+  if ( n.length() < iMath::err )
+    return false;
+
+  n.normalize();
+  frame.set(origin * (1.0/verts.size()), n);
+  return true;
+}
+
+double iPlanar::orient(const Vec3f & a, const Vec3f & b, const Vec3f & c)
+{
+  return (b.x - a.x)*(c.y - a.y) - (b.y - a.y)*(c.x - a.x);
+}
+
+double iPlanar::signedArea(const Points3f & poly)
+{
+  double area = 0;
+  for (size_t i = 0; i < poly.size(); ++i)
+  {
+    const Vec3f & a = poly[i];
+    const Vec3f & b = poly[(i+1) % poly.size()];
+    area += a.x*b.y - b.x*a.y;
+  }
+  return area*0.5;
+}
+
+namespace
+{
+  using iPlanar::orient;
+
+  // orient() with rounding noise of almost collinear points cut off
+  double side(const Vec3f & a, const Vec3f & b, const Vec3f & c)
+  {
+    double o = orient(a, b, c);
+    return fabs(o) > 1e-12 * (b - a).length() * (c - a).length() ? o : 0;
+  }
+
+  // c is on segment ab, given they are collinear
+  bool onSegment(const Vec3f & a, const Vec3f & b, const Vec3f & c)
+  {
+    return std::min(a.x, b.x) <= c.x && c.x <= std::max(a.x, b.x) &&
+           std::min(a.y, b.y) <= c.y && c.y <= std::max(a.y, b.y);
+  }
+
+  typedef std::map<long long, std::vector<int> > Grid;
+
+  // puts edge i from a to b into cells of size cell it passes, column by column. parts of the edge
+  // in a column are widened by a bit, so that rounding doesn't drop a cell the edge touches
+  void rasterize(const Vec3f & a, const Vec3f & b, const Vec3f & origin, double cell, int i, Grid & grid)
+  {
+    const Vec3f & l = a.x <= b.x ? a : b;
+    const Vec3f & r = a.x <= b.x ? b : a;
+    double x0 = (l.x - origin.x)/cell, x1 = (r.x - origin.x)/cell;
+    double y0 = (l.y - origin.y)/cell, y1 = (r.y - origin.y)/cell;
+    const double eps = 1e-6;
+
+    long long c0 = (long long)floor(x0), c1 = (long long)floor(x1);
+    for (long long c = c0; c <= c1; ++c)
+    {
+      double xa = std::max(x0, (double)c), xb = std::min(x1, (double)(c+1));
+      double ya = y0, yb = y1;
+      if ( x1 > x0 )
+      {
+        ya = y0 + (y1 - y0)*(xa - x0)/(x1 - x0);
+        yb = y0 + (y1 - y0)*(xb - x0)/(x1 - x0);
+      }
+
+      long long r0 = (long long)floor(std::min(ya, yb) - eps), r1 = (long long)floor(std::max(ya, yb) + eps);
+      for (long long row = r0; row <= r1; ++row)
+        grid[(c << 32) ^ row].push_back(i);
+    }
+  }
+
+  // crossing or touching
+  bool segmentsIsect(const Vec3f & p0, const Vec3f & p1, const Vec3f & q0, const Vec3f & q1)
+  {
+    double d0 = orient(q0, q1, p0), d1 = orient(q0, q1, p1);
+    double d2 = orient(p0, p1, q0), d3 = orient(p0, p1, q1);
+
+    if ( ((d0 > 0 && d1 < 0) || (d0 < 0 && d1 > 0)) && ((d2 > 0 && d3 < 0) || (d2 < 0 && d3 > 0)) )
+      return true;
+
+    return (d0 == 0 && onSegment(q0, q1, p0)) || (d1 == 0 && onSegment(q0, q1, p1)) ||
+           (d2 == 0 && onSegment(p0, p1, q0)) || (d3 == 0 && onSegment(p0, p1, q1));
+  }
+}
+
+bool iPlanar::isSimple(const Points3f & poly)
+{
+  size_t n = poly.size();
+  if ( n < 3 )
+    return false;
+
+  Rect3f rect;
+  double length = 0;
+  for (size_t i = 0; i < n; ++i)
+  {
+    double l = (poly[(i+1) % n] - poly[i]).length();
+    if ( l <= 0 )
+      return false;
+
+    length += l;
+    rect.add(poly[i]);
+  }
+
+  // edges are tested against the ones sharing a cell. an edge goes only to cells it passes,
+  // not to all cells of its bounding box, so a long slanted one takes O(length/cell) of them
+  double cell = 2*length/n;
+  Grid grid;
+  for (size_t i = 0; i < n; ++i)
+    rasterize(poly[i], poly[(i+1) % n], rect.vmin, cell, (int)i, grid);
+
+  for (Grid::const_iterator c = grid.begin(); c != grid.end(); ++c)
+  {
+    const std::vector<int> & items = c->second;
+    for (size_t i = 0; i < items.size(); ++i)
+    {
+      for (size_t j = i+1; j < items.size(); ++j)
+      {
+        int s = items[i], t = items[j];
+        const Vec3f & p0 = poly[s];
+        const Vec3f & p1 = poly[(s+1) % n];
+        const Vec3f & q0 = poly[t];
+        const Vec3f & q1 = poly[(t+1) % n];
+
+        // neighbors only touch at common point, unless one goes back along the other
+        if ( (size_t)t == (s+1) % n || (size_t)s == (t+1) % n )
+        {
+          const Vec3f & common = (size_t)t == (s+1) % n ? p1 : q1;
+          const Vec3f & a = (size_t)t == (s+1) % n ? p0 : q0;
+          const Vec3f & b = (size_t)t == (s+1) % n ? q1 : p1;
+          if ( orient(common, a, b) == 0 && (a - common)*(b - common) > 0 )
+            return false;
+          continue;
+        }
+
+        if ( segmentsIsect(p0, p1, q0, q1) )
+          return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// monotone partition, see de Berg et al. "Computational Geometry", chapter 3
+namespace
+{
+  enum VertexType { Start, End, Split, Merge, Regular };
+
+  // a is above b in sweep order, ties are broken by x
+  struct Above
+  {
+    Above(const Points3f & pts) : pts_(pts) {}
+
+    bool operator () (int a, int b) const
+    {
+      const Vec3f & p = pts_[a];
+      const Vec3f & q = pts_[b];
+      return p.y > q.y || (p.y == q.y && p.x < q.x);
+    }
+
+    const Points3f & pts_;
+  };
+
+  // edges crossed by sweep line, ordered left to right. edge i goes from point i to i+1
+  // edge_ < 0 is a probe point at x_
+  struct EdgeKey
+  {
+    EdgeKey(int edge, double x) : edge_(edge), x_(x) {}
+
+    int edge_;
+    double x_;
+  };
+
+  struct EdgeLess
+  {
+    EdgeLess(const Points3f & pts, const double & sweepY) : pts_(pts), sweepY_(sweepY) {}
+
+    double x(const EdgeKey & k) const
+    {
+      if ( k.edge_ < 0 )
+        return k.x_;
+
+      const Vec3f & a = pts_[k.edge_];
+      const Vec3f & b = pts_[(k.edge_+1) % pts_.size()];
+      if ( a.y == b.y )
+        return std::min(a.x, b.x);
+
+      return a.x + (b.x - a.x)*(sweepY_ - a.y)/(b.y - a.y);
+    }
+
+    bool operator () (const EdgeKey & a, const EdgeKey & b) const
+    {
+      double xa = x(a), xb = x(b);
+      if ( xa != xb )
+        return xa < xb;
+      return a.edge_ < b.edge_;
+    }
+
+    const Points3f & pts_;
+    const double & sweepY_;
+  };
+
+  typedef std::set<EdgeKey, EdgeLess> Status;
+  typedef std::pair<int, int> Diagonal;
+
+  bool partition(const Points3f & pts, std::vector<Diagonal> & diagonals)
+  {
+    int n = (int)pts.size();
+    Above above(pts);
+
+    std::vector<VertexType> types(n, Regular);
+    std::vector<int> order(n);
+    for (int i = 0; i < n; ++i)
+    {
+      int p = (i+n-1) % n, q = (i+1) % n;
+      bool convex = orient(pts[p], pts[i], pts[q]) > 0;
+      if ( above(i, p) && above(i, q) )
+        types[i] = convex ? Start : Split;
+      else if ( above(p, i) && above(q, i) )
+        types[i] = convex ? End : Merge;
+      order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), above);
+
+    double sweepY = 0;
+    Status status( EdgeLess(pts, sweepY) );
+    std::vector<Status::iterator> where(n, status.end());
+    std::vector<int> helper(n, -1);
+
+    for (int k = 0; k < n; ++k)
+    {
+      int i = order[k], prev = (i+n-1) % n;
+      sweepY = pts[i].y;
+
+      // edge left to vertex i
+      int left = -1;
+      if ( types[i] == Split || types[i] == Merge || (types[i] == Regular && above(i, prev)) )
+      {
+        if ( types[i] == Merge )
+        {
+          if ( where[prev] == status.end() )
+            return false;
+          if ( types[helper[prev]] == Merge )
+            diagonals.push_back(Diagonal(i, helper[prev]));
+          status.erase(where[prev]);
+          where[prev] = status.end();
+        }
+
+        Status::iterator iter = status.lower_bound(EdgeKey(-1, pts[i].x));
+        if ( iter == status.begin() )
+          return false;
+        left = (--iter)->edge_;
+      }
+
+      switch ( types[i] )
+      {
+      case Start:
+        where[i] = status.insert(EdgeKey(i, 0)).first;
+        helper[i] = i;
+        break;
+
+      case End:
+        if ( where[prev] == status.end() )
+          return false;
+        if ( types[helper[prev]] == Merge )
+          diagonals.push_back(Diagonal(i, helper[prev]));
+        status.erase(where[prev]);
+        where[prev] = status.end();
+        break;
+
+      case Split:
+        diagonals.push_back(Diagonal(i, helper[left]));
+        helper[left] = i;
+        where[i] = status.insert(EdgeKey(i, 0)).first;
+        helper[i] = i;
+        break;
+
+      case Merge:
+        if ( types[helper[left]] == Merge )
+          diagonals.push_back(Diagonal(i, helper[left]));
+        helper[left] = i;
+        break;
+
+      case Regular:
+        if ( left < 0 )
+        {
+          // interior is to the right, we are on the left chain
+          if ( where[prev] == status.end() )
+            return false;
+          if ( types[helper[prev]] == Merge )
+            diagonals.push_back(Diagonal(i, helper[prev]));
+          status.erase(where[prev]);
+          where[prev] = status.end();
+          where[i] = status.insert(EdgeKey(i, 0)).first;
+          helper[i] = i;
+        }
+        else
+        {
+          if ( types[helper[left]] == Merge )
+            diagonals.push_back(Diagonal(i, helper[left]));
+          helper[left] = i;
+        }
+        break;
+      }
+    }
+
+    return true;
+  }
+
+  // splits polygon by diagonals into faces, all counter-clockwise
+  void faces(const Points3f & pts, const std::vector<Diagonal> & diagonals, std::vector< std::vector<int> > & result)
+  {
+    int n = (int)pts.size();
+
+    // neighbors of every vertex, counter-clockwise
+    std::vector< std::vector<int> > around(n);
+    for (int i = 0; i < n; ++i)
+    {
+      around[i].push_back((i+1) % n);
+      around[i].push_back((i+n-1) % n);
+    }
+    for (size_t i = 0; i < diagonals.size(); ++i)
+    {
+      around[diagonals[i].first].push_back(diagonals[i].second);
+      around[diagonals[i].second].push_back(diagonals[i].first);
+    }
+
+    std::vector< std::vector<char> > used(n);
+    for (int i = 0; i < n; ++i)
+    {
+      std::vector< std::pair<double, int> > angles;
+      for (size_t j = 0; j < around[i].size(); ++j)
+      {
+        Vec3f d = pts[around[i][j]] - pts[i];
+        angles.push_back(std::make_pair(atan2(d.y, d.x), around[i][j]));
+      }
+      std::sort(angles.begin(), angles.end());
+      for (size_t j = 0; j < angles.size(); ++j)
+        around[i][j] = angles[j].second;
+      used[i].assign(around[i].size(), 0);
+    }
+
+    for (int i = 0; i < n; ++i)
+    {
+      for (size_t j = 0; j < around[i].size(); ++j)
+      {
+        // outer side of polygon edge
+        if ( used[i][j] || around[i][j] == (i+n-1) % n )
+          continue;
+
+        std::vector<int> face;
+        int from = i;
+        size_t k = j;
+        while ( !used[from][k] )
+        {
+          used[from][k] = 1;
+          face.push_back(from);
+
+          // next is clockwise to the way back
+          int to = around[from][k];
+          std::vector<int> & a = around[to];
+          size_t back = std::find(a.begin(), a.end(), from) - a.begin();
+          from = to;
+          k = (back + a.size() - 1) % a.size();
+        }
+
+        result.push_back(face);
+      }
+    }
+  }
+
+  // returns false for degenerate triangle
+  bool addTriangle(const Points3f & pts, int a, int b, int c, Triangles & tris)
+  {
+    double o = side(pts[a], pts[b], pts[c]);
+    if ( o < 0 )
+      std::swap(b, c);
+    tris.push_back(Triangle(a, b, c));
+    return o != 0;
+  }
+
+  // y-monotone counter-clockwise face. false if some triangle is degenerate
+  bool triangulateMonotone(const Points3f & pts, const std::vector<int> & face, Triangles & tris)
+  {
+    size_t m = face.size();
+    if ( m < 3 )
+      return false;
+
+    bool ok = true;
+    Above above(pts);
+    size_t top = 0, bottom = 0;
+    for (size_t i = 1; i < m; ++i)
+    {
+      if ( above(face[i], face[top]) )
+        top = i;
+      if ( above(face[bottom], face[i]) )
+        bottom = i;
+    }
+
+    // going forward from top is the left chain, backward - the right one
+    std::vector<int> sorted;
+    std::vector<char> onLeft;
+    size_t l = (top+1) % m, r = (top+m-1) % m;
+    sorted.push_back(face[top]);
+    onLeft.push_back(1);
+    while ( sorted.size() < m )
+    {
+      if ( l != bottom && (r == bottom || above(face[l], face[r])) )
+      {
+        sorted.push_back(face[l]);
+        onLeft.push_back(1);
+        l = (l+1) % m;
+      }
+      else if ( r != bottom )
+      {
+        sorted.push_back(face[r]);
+        onLeft.push_back(0);
+        r = (r+m-1) % m;
+      }
+      else
+      {
+        sorted.push_back(face[bottom]);
+        onLeft.push_back(0);
+      }
+    }
+
+    std::vector<size_t> stack;
+    stack.push_back(0);
+    stack.push_back(1);
+    for (size_t j = 2; j+1 < m; ++j)
+    {
+      if ( onLeft[j] != onLeft[stack.back()] )
+      {
+        for ( ; stack.size() > 1; stack.pop_back())
+          ok = addTriangle(pts, sorted[j], sorted[stack.back()], sorted[stack[stack.size()-2]], tris) && ok;
+        stack.clear();
+        stack.push_back(j-1);
+        stack.push_back(j);
+      }
+      else
+      {
+        size_t last = stack.back();
+        stack.pop_back();
+        for ( ; !stack.empty(); stack.pop_back())
+        {
+          const Vec3f & uj = pts[sorted[j]];
+          double o = side(uj, pts[sorted[stack.back()]], pts[sorted[last]]);
+          if ( onLeft[j] ? o <= 0 : o >= 0 )
+            break;
+
+          ok = addTriangle(pts, sorted[j], sorted[last], sorted[stack.back()], tris) && ok;
+          last = stack.back();
+        }
+        stack.push_back(last);
+        stack.push_back(j);
+      }
+    }
+
+    for ( ; stack.size() > 1; stack.pop_back())
+      ok = addTriangle(pts, sorted[m-1], sorted[stack.back()], sorted[stack[stack.size()-2]], tris) && ok;
+
+    return ok;
+  }
+}
+
+bool iPlanar::triangulate(const Points3f & poly, Triangles & tris)
+{
+  size_t n = poly.size();
+  if ( n < 3 )
+    return false;
+
+  std::vector<Diagonal> diagonals;
+  if ( !partition(poly, diagonals) )
+    return false;
+
+  std::vector< std::vector<int> > pieces;
+  faces(poly, diagonals, pieces);
+
+  size_t first = tris.size();
+  tris.reserve(first + n-2);
+  bool ok = true;
+  for (size_t i = 0; i < pieces.size(); ++i)
+    ok = triangulateMonotone(poly, pieces[i], tris) && ok;
+
+  if ( !ok || tris.size() - first != n-2 )
+  {
+    tris.resize(first);
+    return false;
+  }
+
+  return true;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "vec.h"
+
+// 2d polygons triangulation. 2d points are Vec3f with z = 0
+namespace iPlanar
+{
+
+// orthonormal frame of plane, p = origin_ + u_*x + v_*y + n_*z
+struct PlaneFrame
+{
+  Vec3f origin_, u_, v_, n_;
+
+  // n should be normalized
+  void set(const Vec3f & origin, const Vec3f & n);
+
+  Vec3f project(const Vec3f & p) const;
+};
+
+// true if all normals are the same and all points lie in the plane with this normal
+// tolerance is relative to bounding box diagonal
+bool planarFrame(const Vertices & verts, double tolerance, PlaneFrame & frame);
+
+// plane through centroid with averaged normal. false if normals cancel out
+bool fitFrame(const Vertices & verts, PlaneFrame & frame);
+
+// plane through centroid orthogonal to the vector area of the loop, Newell's method
+bool areaFrame(const Vertices & verts, PlaneFrame & frame);
+
+// positive if c is to the left of ab
+double orient(const Vec3f & a, const Vec3f & b, const Vec3f & c);
+
+// positive for counter-clockwise polygon
+double signedArea(const Points3f & poly);
+
+// no repeated points, no touching or crossing edges. edges sharing a cell of uniform grid are tested,
+// O(n) if edges are spread evenly over cells, O(n^2) at worst when most of them crowd into a few cells
+bool isSimple(const Points3f & poly);
+
+// triangulates simple counter-clockwise polygon by monotone partition, O(n log n)
+// triangles are counter-clockwise. returns false if polygon turned out not to be simple
+bool triangulate(const Points3f & poly, Triangles & tris);
+
+}
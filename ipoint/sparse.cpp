@@ -0,0 +1,197 @@
+#include "sparse.h"
+#include "taskpool.h"
+#include <math.h>
+#include <algorithm>
+#include <boost/bind/bind.hpp>
+
+void iSparse::Matrix::addRow(const std::vector<int> & columns, const std::vector<double> & values)
+{
+  columns_.insert(columns_.end(), columns.begin(), columns.end());
+  values_.insert(values_.end(), values.begin(), values.end());
+  rows_.push_back((int)columns_.size());
+}
+
+void iSparse::Matrix::multiply(const std::vector<double> & x, std::vector<double> & y, size_t begin, size_t end) const
+{
+  for (size_t i = begin; i < end; ++i)
+  {
+    double s = 0;
+    for (int j = rows_[i]; j < rows_[i+1]; ++j)
+      s += values_[j] * x[columns_[j]];
+    y[i] = s;
+  }
+}
+
+namespace
+{
+  // rows of one block, partial dot products are kept per block
+  const size_t blockSize = 1024;
+
+  class Solver
+  {
+  public:
+
+    Solver(const iSparse::Matrix & A, const std::vector<double> & b, std::vector<double> & x) :
+      A_(A), b_(b), x_(x), alpha_(0), beta_(0)
+    {
+      size_t n = A.size();
+      r_.resize(n);
+      z_.resize(n);
+      p_.resize(n);
+      q_.resize(n);
+      inverse_.resize(n);
+      for (size_t i = 0; i < n; ++i)
+      {
+        double d = 0;
+        for (int j = A.rows_[i]; j < A.rows_[i+1]; ++j)
+          if ( A.columns_[j] == (int)i )
+            d = A.values_[j];
+        inverse_[i] = d != 0 ? 1.0/d : 1.0;
+      }
+
+      blocksN_ = (n + blockSize - 1) / blockSize;
+      partial_.resize(blocksN_);
+      partial2_.resize(blocksN_);
+    }
+
+    size_t blocksCount() const { return blocksN_; }
+
+    double sum() const { return sum(partial_); }
+    double sum2() const { return sum(partial2_); }
+
+    void setAlpha(double alpha) { alpha_ = alpha; }
+    void setBeta(double beta) { beta_ = beta; }
+
+    // r = b - A*x, p = z = M^-1 * r. partial_ is r*z, partial2_ is b*b
+    void start(size_t begin, size_t end)
+    {
+      for (size_t k = begin; k < end; ++k)
+      {
+        size_t first = k*blockSize, last = std::min(first + blockSize, A_.size());
+        A_.multiply(x_, q_, first, last);
+        double rz = 0, bb = 0;
+        for (size_t i = first; i < last; ++i)
+        {
+          r_[i] = b_[i] - q_[i];
+          z_[i] = p_[i] = inverse_[i] * r_[i];
+          rz += r_[i] * z_[i];
+          bb += b_[i] * b_[i];
+        }
+        partial_[k] = rz;
+        partial2_[k] = bb;
+      }
+    }
+
+    // q = A*p. partial_ is p*q
+    void product(size_t begin, size_t end)
+    {
+      for (size_t k = begin; k < end; ++k)
+      {
+        size_t first = k*blockSize, last = std::min(first + blockSize, A_.size());
+        A_.multiply(p_, q_, first, last);
+        double pq = 0;
+        for (size_t i = first; i < last; ++i)
+          pq += p_[i] * q_[i];
+        partial_[k] = pq;
+      }
+    }
+
+    // x += alpha*p, r -= alpha*q, z = M^-1 * r. partial_ is r*z, partial2_ is r*r
+    void update(size_t begin, size_t end)
+    {
+      for (size_t k = begin; k < end; ++k)
+      {
+        size_t first = k*blockSize, last = std::min(first + blockSize, A_.size());
+        double rz = 0, rr = 0;
+        for (size_t i = first; i < last; ++i)
+        {
+          x_[i] += alpha_ * p_[i];
+          r_[i] -= alpha_ * q_[i];
+          z_[i] = inverse_[i] * r_[i];
+          rz += r_[i] * z_[i];
+          rr += r_[i] * r_[i];
+        }
+        partial_[k] = rz;
+        partial2_[k] = rr;
+      }
+    }
+
+    // p = z + beta*p
+    void direction(size_t begin, size_t end)
+    {
+      for (size_t k = begin; k < end; ++k)
+      {
+        size_t first = k*blockSize, last = std::min(first + blockSize, A_.size());
+        for (size_t i = first; i < last; ++i)
+          p_[i] = z_[i] + beta_ * p_[i];
+      }
+    }
+
+  private:
+
+    static double sum(const std::vector<double> & partial)
+    {
+      double s = 0;
+      for (size_t k = 0; k < partial.size(); ++k)
+        s += partial[k];
+      return s;
+    }
+
+    const iSparse::Matrix & A_;
+    const std::vector<double> & b_;
+    std::vector<double> & x_;
+
+    std::vector<double> r_, z_, p_, q_, inverse_;
+    size_t blocksN_;
+    std::vector<double> partial_, partial2_;
+    double alpha_, beta_;
+  };
+
+  void forBlocks(TaskPool * pool, size_t n, const TaskPool::Range & body)
+  {
+    if ( pool )
+      pool->parallelFor(n, 1, body);
+    else
+      body(0, n);
+  }
+}
+
+int iSparse::solveCG(const Matrix & A, const std::vector<double> & b, std::vector<double> & x, double tolerance, int maxIters, TaskPool * pool)
+{
+  if ( A.size() == 0 )
+    return 0;
+
+  using boost::placeholders::_1;
+  using boost::placeholders::_2;
+
+  Solver solver(A, b, x);
+  size_t n = solver.blocksCount();
+
+  forBlocks(pool, n, boost::bind(&Solver::start, &solver, _1, _2));
+  double rz = solver.sum();
+  double limit = tolerance*tolerance * solver.sum2();
+
+  int iters = 0;
+  for ( ; iters < maxIters && rz > 0; ++iters)
+  {
+    forBlocks(pool, n, boost::bind(&Solver::product, &solver, _1, _2));
+    double pq = solver.sum();
+    if ( pq <= 0 )
+      break;
+
+    solver.setAlpha(rz / pq);
+    forBlocks(pool, n, boost::bind(&Solver::update, &solver, _1, _2));
+    double rzNext = solver.sum();
+    if ( solver.sum2() <= limit )
+    {
+      iters++;
+      break;
+    }
+
+    solver.setBeta(rzNext / rz);
+    rz = rzNext;
+    forBlocks(pool, n, boost::bind(&Solver::direction, &solver, _1, _2));
+  }
+
+  return iters;
+}
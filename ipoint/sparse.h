@@ -0,0 +1,37 @@
+#pragma once
+
+#include <vector>
+#include <stddef.h>
+
+class TaskPool;
+
+// sparse symmetric positive definite systems
+namespace iSparse
+{
+
+// compressed sparse rows
+struct Matrix
+{
+  // row i is columns_/values_ in [rows_[i], rows_[i+1])
+  std::vector<int> rows_;
+  std::vector<int> columns_;
+  std::vector<double> values_;
+
+  Matrix() : rows_(1, 0) {}
+
+  size_t size() const { return rows_.size()-1; }
+
+  // appends next row, columns should be sorted
+  void addRow(const std::vector<int> & columns, const std::vector<double> & values);
+
+  // y = A*x for rows [begin, end)
+  void multiply(const std::vector<double> & x, std::vector<double> & y, size_t begin, size_t end) const;
+};
+
+// conjugate gradient with Jacobi preconditioner, x is initial guess and result.
+// stops when residual is below tolerance relative to b or after maxIters, returns number of iterations.
+// vector operations are split between pool workers if there is a pool. dot products are summed
+// from fixed blocks of rows, so x doesn't depend on the number of workers
+int solveCG(const Matrix & A, const std::vector<double> & b, std::vector<double> & x, double tolerance, int maxIters, TaskPool * pool);
+
+}
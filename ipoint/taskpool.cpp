@@ -0,0 +1,231 @@
+#include "taskpool.h"
+#include "iprofile.h"
+#include <stdexcept>
+#include <algorithm>
+#include <boost/bind/bind.hpp>
+
+TaskPool::TaskPool(size_t threadsN) :
+  queued_(0), pending_(0), stealsN_(0), stop_(false), failed_(false)
+{
+  if ( threadsN < 1 )
+    threadsN = 1;
+
+  for (size_t i = 0; i < threadsN; ++i)
+    queues_.push_back( boost::shared_ptr<Queue>(new Queue) );
+
+  for (size_t i = 1; i < threadsN; ++i)
+    threads_.create_thread( boost::bind(&TaskPool::worker, this, i) );
+}
+
+TaskPool::~TaskPool()
+{
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    stop_ = true;
+  }
+  wake_.notify_all();
+  threads_.join_all();
+}
+
+size_t TaskPool::workerIndex() const
+{
+  return index_.get() ? *index_ : 0;
+}
+
+void TaskPool::submit(const Task & task)
+{
+  size_t index = workerIndex();
+
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    queued_++;
+    pending_++;
+  }
+
+  {
+    Queue & q = *queues_[index];
+    boost::mutex::scoped_lock lock(q.mutex_);
+    q.tasks_.push_back(task);
+  }
+
+  wake_.notify_all();
+}
+
+void TaskPool::run()
+{
+  if ( !index_.get() )
+    index_.reset(new size_t(0));
+
+  for ( ;; )
+  {
+    Task task;
+    if ( take(0, task) )
+    {
+      execute(task);
+      continue;
+    }
+
+    boost::mutex::scoped_lock lock(mutex_);
+    while ( queued_ == 0 && pending_ > 0 )
+      wake_.wait(lock);
+
+    if ( pending_ == 0 )
+      break;
+  }
+
+  boost::mutex::scoped_lock lock(mutex_);
+  iAlloc::addToThread(workerAlloc_);
+  workerAlloc_ = AllocSample();
+
+  if ( failed_ )
+  {
+    failed_ = false;
+    throw std::runtime_error(error_);
+  }
+}
+
+void TaskPool::parallelFor(size_t n, size_t grain, const Range & body)
+{
+  // a few chunks per worker to even out the load
+  size_t chunks = std::min((n + grain - 1) / std::max(grain, (size_t)1), queues_.size()*4);
+  if ( chunks <= 1 )
+  {
+    body(0, n);
+    return;
+  }
+
+  for (size_t i = 0; i < chunks; ++i)
+    submit( boost::bind(body, n*i/chunks, n*(i+1)/chunks) );
+
+  run();
+}
+
+void TaskPool::worker(size_t index)
+{
+  index_.reset(new size_t(index));
+  iProfile::setWorkerThread();
+
+  for ( ;; )
+  {
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      while ( !stop_ && queued_ == 0 )
+        wake_.wait(lock);
+
+      if ( stop_ )
+        return;
+    }
+
+    Task task;
+    if ( take(index, task) )
+      execute(task);
+  }
+}
+
+bool TaskPool::take(size_t index, Task & task)
+{
+  bool stolen = false;
+  for (size_t i = 0; i < queues_.size() && task.empty(); ++i)
+  {
+    Queue & q = *queues_[(index + i) % queues_.size()];
+    boost::mutex::scoped_lock lock(q.mutex_);
+    if ( q.tasks_.empty() )
+      continue;
+
+    // own tasks from the back, others' from the front
+    if ( i == 0 )
+    {
+      task.swap(q.tasks_.back());
+      q.tasks_.pop_back();
+    }
+    else
+    {
+      task.swap(q.tasks_.front());
+      q.tasks_.pop_front();
+      stolen = true;
+    }
+  }
+
+  if ( task.empty() )
+    return false;
+
+  boost::mutex::scoped_lock lock(mutex_);
+  queued_--;
+  if ( stolen )
+    stealsN_++;
+  return true;
+}
+
+void TaskPool::execute(const Task & task)
+{
+  bool skip = false;
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    skip = failed_;
+  }
+
+  // the thread calling run() counts its own allocations
+  bool worker = *index_ != 0;
+  AllocSample alloc;
+  if ( worker )
+  {
+    iAlloc::resetThreadPeak();
+    alloc = iAlloc::threadSample();
+  }
+
+  if ( !skip )
+  {
+    std::string error;
+    try
+    {
+      task();
+    }
+    catch ( std::exception & e )
+    {
+      error = e.what();
+      skip = true;
+    }
+    catch ( ... )
+    {
+      error = "unknown error in task";
+      skip = true;
+    }
+
+    if ( skip )
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      if ( !failed_ )
+      {
+        failed_ = true;
+        error_ = error;
+      }
+    }
+  }
+
+  if ( worker )
+  {
+    AllocSample done = iAlloc::threadSample();
+    alloc.allocs_ = done.allocs_ - alloc.allocs_;
+    alloc.frees_ = done.frees_ - alloc.frees_;
+    alloc.bytes_ = done.bytes_ - alloc.bytes_;
+    alloc.peak_ = done.peak_ - alloc.current_;
+    alloc.current_ = done.current_ - alloc.current_;
+  }
+
+  bool last = false;
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    if ( worker )
+    {
+      workerAlloc_.allocs_ += alloc.allocs_;
+      workerAlloc_.frees_ += alloc.frees_;
+      workerAlloc_.bytes_ += alloc.bytes_;
+      workerAlloc_.current_ += alloc.current_;
+      workerAlloc_.peak_ += alloc.peak_;
+    }
+    last = --pending_ == 0;
+  }
+
+  if ( last )
+    wake_.notify_all();
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+#include <string>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/tss.hpp>
+#include "alloctrack.h"
+
+/**
+  Work-stealing pool for recursive tasks
+
+  Every worker has its own deque. Tasks submitted by a worker go to the back of its deque
+  and are taken back from there, so a worker goes depth first through its part of work.
+  Idle workers steal from the front of other deques, i.e. the oldest and usually the biggest
+  tasks. The thread calling run() is worker 0, other workers sleep between runs.
+*/
+class TaskPool
+{
+  struct Queue
+  {
+    boost::mutex mutex_;
+    std::deque< boost::function<void ()> > tasks_;
+  };
+
+public:
+
+  typedef boost::function<void ()> Task;
+  typedef boost::function<void (size_t begin, size_t end)> Range;
+
+  // threadsN workers including the one calling run()
+  TaskPool(size_t threadsN);
+  ~TaskPool();
+
+  size_t threadsCount() const { return queues_.size(); }
+
+  // call it from a task or before run()
+  void submit(const Task & task);
+
+  // executes tasks until all of them, including the ones submitted on the way, are done.
+  // if some task throws, the rest are skipped and the first error is rethrown as std::runtime_error
+  void run();
+
+  // splits [0, n) into chunks of at least grain items and runs them. not for use from a task
+  void parallelFor(size_t n, size_t grain, const Range & body);
+
+  // tasks taken from other workers' deques
+  size_t stealsCount() const { return stealsN_; }
+
+  // worker running the calling thread, 0 for threads outside the pool
+  size_t workerIndex() const;
+
+private:
+
+  void worker(size_t index);
+  bool take(size_t index, Task & task);
+  void execute(const Task & task);
+
+  std::vector< boost::shared_ptr<Queue> > queues_;
+  boost::thread_group threads_;
+  boost::thread_specific_ptr<size_t> index_;
+
+  boost::mutex mutex_;
+  boost::condition_variable wake_;
+
+  // allocations made by tasks on other workers, added to the thread calling run() when they are done.
+  // peaks of concurrent tasks are summed
+  AllocSample workerAlloc_;
+
+  // submitted and not taken yet / not finished yet
+  size_t queued_, pending_;
+  size_t stealsN_;
+  bool stop_;
+
+  bool failed_;
+  std::string error_;
+};
@@ -0,0 +1,78 @@
+#include "engine.h"
+#include "meshcheck.h"
+#include "pipeline.h"
+#include <iostream>
+
+#ifndef DATA_DIR
+#define DATA_DIR "data"
+#endif
+
+// smoothtest [data directory]
+// vertex smoothing must not leave self-intersections or degenerate triangles
+// where smoothing edge by edge doesn't. exits with 1 on failure
+namespace
+{
+  const char * files[] = { "boundary_man.txt", "boundary-man-1.txt", "boundary_ear.txt" };
+
+  bool check(const std::string & fname, const char * name, const TriangulationOptions & options)
+  {
+    std::vector<std::string> fnames(1, fname);
+    BoundaryReader reader(fnames);
+    BoundaryHole hole;
+    bool ok = true;
+    size_t holesN = 0;
+    while ( reader.next(hole) )
+    {
+      holesN++;
+      std::cout << hole.source_ << "#" << hole.index_ << " " << name << ": ";
+
+      Vertices verts(hole.verts_);
+      Triangles tris;
+      MeshCheck result;
+      try
+      {
+        DelaunayTriangulator dtr(verts, options);
+        dtr.triangulate(tris);
+        iMesh::checkMesh(hole.verts_, verts, tris, result);
+        iMesh::writeCheck(std::cout, result);
+      }
+      catch ( std::exception & e )
+      {
+        std::cout << "failed, " << e.what();
+        ok = false;
+      }
+      std::cout << "\n";
+
+      ok = ok && result.valid();
+    }
+
+    if ( !holesN )
+    {
+      std::cout << "can't read " << fname << "\n";
+      return false;
+    }
+    return ok;
+  }
+}
+
+int main(int argc, char * argv[])
+{
+  std::string dir = argc > 1 ? argv[1] : DATA_DIR;
+
+  TriangulationOptions smoothing = iEngine::legacyOptions();
+  smoothing.vertexSmoothing_ = true;
+
+  TriangulationOptions parallel = smoothing;
+  parallel.threads_ = 3;
+
+  bool ok = true;
+  for (size_t i = 0; i < sizeof(files)/sizeof(files[0]); ++i)
+  {
+    std::string fname = dir + "/" + files[i];
+    ok = check(fname, "vertex smoothing", smoothing) && ok;
+    ok = check(fname, "vertex smoothing, 3 threads", parallel) && ok;
+  }
+
+  std::cout << (ok ? "passed" : "FAILED") << "\n";
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,16 @@
+TEMPLATE = app
+TARGET = smoothtest
+CONFIG += console
+CONFIG -= qt app_bundle
+
+include(../core.pri)
+
+DEFINES += DATA_DIR=\\\"$$PWD/../data\\\"
+
+SOURCES += smoothtest.cpp
+
+CONFIG(debug, debug|release) {
+    DESTDIR = ../../build/debug
+} else {
+    DESTDIR = ../../build/release
+}
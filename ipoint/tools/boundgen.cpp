@@ -0,0 +1,205 @@
+#include "boundgen.h"
+#include <math.h>
+#include <algorithm>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_real_distribution.hpp>
+
+namespace
+{
+  const double pi = 3.14159265358979;
+
+  // 2d outline in xy plane. straight_[i] is set if segment i..i+1 is a collinear run
+  struct Outline
+  {
+    std::vector<Vec3f> pts_;
+    std::vector<char> straight_;
+
+    void add(double x, double y, bool straight = false)
+    {
+      pts_.push_back(Vec3f(x, y, 0));
+      straight_.push_back(straight);
+    }
+
+    void addPolar(double r, double a, bool straight = false)
+    {
+      add(r*cos(a), r*sin(a), straight);
+    }
+  };
+
+  // bumpy star shaped curve, always positive
+  struct Star
+  {
+    Star(double radius, double phase3, double phase5) : radius_(radius), phase3_(phase3), phase5_(phase5) {}
+
+    double operator () (double a) const
+    {
+      return radius_*(1.0 + 0.15*sin(3*a + phase3_) + 0.1*sin(5*a + phase5_));
+    }
+
+    double radius_, phase3_, phase5_;
+  };
+
+  void starOutline(const iGen::LoopParams & params, const Star & star, size_t samplesN, Outline & outline)
+  {
+    double R = params.radius_;
+
+    // channels and collinear runs as angular events
+    int channelsN = params.channels_;
+    double w = params.channelWidth_*R, depth = 0.3*R;
+
+    // walls of neighbor channels must not meet at the bottom
+    int channelsMax = (int)(pi / asin(std::min(1.0, w / (2*depth)))) - 1;
+    channelsN = std::max(0, std::min(channelsN, channelsMax));
+
+    std::vector<double> channels;
+    for (int i = 0; i < channelsN; ++i)
+      channels.push_back(2*pi*(i + 0.5)/channelsN);
+
+    // collinear runs don't cover channels
+    std::vector< std::pair<double, double> > runs;
+    for (int i = 0; i < params.collinear_; ++i)
+    {
+      double a0 = 2*pi*(i + 0.1)/params.collinear_, a1 = a0 + 2*pi*0.3/params.collinear_;
+      bool free = true;
+      for (size_t j = 0; j < channels.size(); ++j)
+        free = free && (channels[j] + 0.2 < a0 || channels[j] - 0.2 > a1);
+      if ( free )
+        runs.push_back(std::make_pair(a0, a1));
+    }
+
+    size_t nextChannel = 0, nextRun = 0;
+    for (size_t i = 0; i < samplesN; ++i)
+    {
+      double a = 2*pi*i/samplesN;
+
+      if ( nextRun < runs.size() && a >= runs[nextRun].first )
+      {
+        // chord from the start of run to its end
+        outline.addPolar(star(runs[nextRun].first), runs[nextRun].first, true);
+        double a1 = runs[nextRun].second;
+        for ( ; i+1 < samplesN && 2*pi*(i+1)/samplesN < a1; ++i);
+        outline.addPolar(star(a1), a1);
+        nextRun++;
+        continue;
+      }
+
+      double c = nextChannel < channels.size() ? channels[nextChannel] : 0, r = star(c);
+      double da = asin(std::min(1.0, w/(2*r)));
+      if ( nextChannel < channels.size() && a >= c - da )
+      {
+        // parallel walls going inside
+        Vec3f d(cos(c), sin(c), 0), p(-d.y, d.x, 0);
+        for ( ; i+1 < samplesN && 2*pi*(i+1)/samplesN < c + da; ++i);
+
+        Vec3f q0 = d*r - p*(w/2), q1 = d*depth - p*(w/2), q2 = d*depth + p*(w/2), q3 = d*r + p*(w/2);
+        outline.add(q0.x, q0.y);
+        outline.add(q1.x, q1.y);
+        outline.add(q2.x, q2.y);
+        outline.add(q3.x, q3.y);
+        nextChannel++;
+        continue;
+      }
+
+      outline.addPolar(star(a), a);
+    }
+  }
+
+  void spiralOutline(const iGen::LoopParams & params, size_t samplesN, Outline & outline)
+  {
+    double R = params.radius_;
+    double turns = params.spiral_, maxA = 2*pi*turns;
+    double w = 0.3*R/turns;
+
+    // arm center goes from 0.25*R to R, arm takes 0.4 of the space between turns
+    size_t sideN = samplesN/2;
+    for (size_t i = 0; i <= sideN; ++i)
+    {
+      double a = maxA*i/sideN;
+      outline.addPolar(R*(0.25 + 0.75*a/maxA) + w/2, a);
+    }
+
+    for (size_t i = 0; i <= sideN; ++i)
+    {
+      double a = maxA*(sideN - i)/sideN;
+      outline.addPolar(R*(0.25 + 0.75*a/maxA) - w/2, a);
+    }
+  }
+
+  // places pointsN points evenly along closed outline
+  void resample(const Outline & outline, size_t pointsN, Outline & result)
+  {
+    const std::vector<Vec3f> & pts = outline.pts_;
+    size_t n = pts.size();
+
+    double length = 0;
+    for (size_t i = 0; i < n; ++i)
+      length += (pts[(i+1) % n] - pts[i]).length();
+
+    double step = length / pointsN, pos = 0;
+    size_t seg = 0;
+    double segFrom = 0, segLength = (pts[1 % n] - pts[0]).length();
+    for (size_t i = 0; i < pointsN; ++i, pos += step)
+    {
+      for ( ; segFrom + segLength < pos && seg+1 < n; )
+      {
+        segFrom += segLength;
+        seg++;
+        segLength = (pts[(seg+1) % n] - pts[seg]).length();
+      }
+
+      double t = segLength > 0 ? (pos - segFrom) / segLength : 0;
+      Vec3f p = pts[seg] + (pts[(seg+1) % n] - pts[seg])*t;
+      result.add(p.x, p.y, outline.straight_[seg] != 0);
+    }
+  }
+}
+
+void iGen::generateLoop(const LoopParams & params, Vertices & verts)
+{
+  boost::random::mt19937 rng(params.seed_);
+  boost::random::uniform_real_distribution<double> uniform(-1, 1);
+
+  size_t pointsN = std::max(params.points_, (size_t)8);
+
+  // curved parts are sampled denser than the result, so resampling doesn't make them collinear
+  Outline outline;
+  if ( params.spiral_ > 0 )
+    spiralOutline(params, pointsN*2, outline);
+  else
+    starOutline(params, Star(params.radius_, pi*uniform(rng), pi*uniform(rng)), pointsN*2, outline);
+
+  Outline even;
+  resample(outline, pointsN, even);
+
+  std::vector<Vec3f> & pts = even.pts_;
+  size_t n = pts.size();
+  double step = 0;
+  for (size_t i = 0; i < n; ++i)
+    step += (pts[(i+1) % n] - pts[i]).length();
+  step /= n;
+
+  // shift across the outline. collinear runs are only disturbed to be near degenerate
+  std::vector<Vec3f> shifted(pts);
+  for (size_t i = 0; i < n; ++i)
+  {
+    Vec3f t = pts[(i+1) % n] - pts[(i+n-1) % n];
+    Vec3f d(-t.y, t.x, 0);
+    if ( d.length() <= 0 )
+      continue;
+    d.normalize();
+
+    double amp = even.straight_[i] ? 1e-6 : params.noise_;
+    shifted[i] += d*(amp*step*uniform(rng));
+  }
+
+  // lift onto paraboloid
+  double k = params.curvature_ / params.radius_;
+  verts.resize(n);
+  for (size_t i = 0; i < n; ++i)
+  {
+    const Vec3f & p = shifted[i];
+    Vec3f nor(-k*p.x, -k*p.y, 1);
+    nor.normalize();
+    verts[i] = Vertex(Vec3f(p.x, p.y, k*(p.x*p.x + p.y*p.y)/2), nor);
+  }
+}
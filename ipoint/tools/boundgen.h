@@ -0,0 +1,42 @@
+#pragma once
+
+#include "vec.h"
+
+// synthetic boundaries for scaling benchmarks
+namespace iGen
+{
+
+struct LoopParams
+{
+  LoopParams() :
+    points_(1000), radius_(1.0), noise_(0), curvature_(0),
+    spiral_(0), channels_(0), channelWidth_(0.05), collinear_(0), seed_(1)
+  {}
+
+  size_t points_;
+  double radius_;
+
+  // random shift of points across boundary, in edge lengths. keep below 0.5 for narrow shapes
+  double noise_;
+
+  // boundary lies on paraboloid z = curvature_*(x^2 + y^2)/(2*radius_)
+  double curvature_;
+
+  // number of turns of spiral arm, 0 for star shaped loop
+  int spiral_;
+
+  // narrow channels cut into star shaped loop, width relative to radius
+  int channels_;
+  double channelWidth_;
+
+  // straight runs of collinear points, slightly disturbed
+  int collinear_;
+
+  unsigned seed_;
+};
+
+// closed loop, counter-clockwise looking against normals like the boundaries in data/
+// normals are the normals of the surface the loop lies on
+void generateLoop(const LoopParams & params, Vertices & verts);
+
+}
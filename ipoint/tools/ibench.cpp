@@ -0,0 +1,329 @@
+#include "engine.h"
+#include "pipeline.h"
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+#include <cstring>
+#include <math.h>
+#include <boost/chrono.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/json_parser.hpp>
+
+using boost::property_tree::ptree;
+
+// ibench run [-a engine] [-n repeats] [-o results] boundary files...
+// ibench compare [-t tolerance] [-k sigmas] [-f floor] baseline results
+static void usage()
+{
+  std::vector<std::string> names;
+  iEngine::names(names);
+
+  std::cerr << "usage: ibench run [-a engine] [-n repeats] [-o results] boundary files...\n";
+  std::cerr << "       ibench compare [-t tolerance] [-k sigmas] [-f floor] baseline results\n";
+  std::cerr << "  run      triangulates every hole n times (5 by default) with engine (default)\n";
+  std::cerr << "           and writes mean, stddev and min of total and per stage times to json.\n";
+  std::cerr << "           allocations and bytes of every stage are written too, if tracked\n";
+  std::cerr << "  compare  reports metrics bigger than baseline by more than both tolerance (0.05)\n";
+  std::cerr << "           and k (3) standard deviations of the two runs. times below floor\n";
+  std::cerr << "           seconds (0.001) in baseline are ignored. exits with 2 on regressions,\n";
+  std::cerr << "           inputs missing in results or changed triangle counts\n";
+  std::cerr << "  engines:";
+  for (size_t i = 0; i < names.size(); ++i)
+    std::cerr << " " << names[i];
+  std::cerr << "\n";
+}
+
+namespace
+{
+  // samples of one metric over repeats. unit_ is "s" for times, "allocs" or "bytes"
+  struct Samples
+  {
+    std::string name_, unit_;
+    std::vector<double> values_;
+
+    void write(ptree & metrics) const
+    {
+      double sum = 0, minv = values_.empty() ? 0 : values_[0];
+      for (size_t i = 0; i < values_.size(); ++i)
+      {
+        sum += values_[i];
+        minv = std::min(minv, values_[i]);
+      }
+
+      double mean = values_.empty() ? 0 : sum / values_.size(), var = 0;
+      for (size_t i = 0; i < values_.size(); ++i)
+        var += (values_[i] - mean)*(values_[i] - mean);
+      if ( values_.size() > 1 )
+        var /= values_.size() - 1;
+
+      ptree metric;
+      metric.put("name", name_);
+      metric.put("unit", unit_);
+      metric.put("mean", mean);
+      metric.put("stddev", sqrt(var));
+      metric.put("min", minv);
+      metrics.push_back(std::make_pair("", metric));
+    }
+  };
+
+  Samples & samples(std::vector<Samples> & all, const std::string & name, const char * unit = "s")
+  {
+    for (size_t i = 0; i < all.size(); ++i)
+    {
+      if ( all[i].name_ == name )
+        return all[i];
+    }
+
+    all.push_back(Samples());
+    all.back().name_ = name;
+    all.back().unit_ = unit;
+    return all.back();
+  }
+
+  int run(int argc, char * argv[])
+  {
+    int repeats = 5;
+    const char * outName = 0;
+    std::string engineName = "default";
+    std::vector<std::string> fnames;
+
+    for (int i = 0; i < argc; ++i)
+    {
+      if ( !strcmp(argv[i], "-a") && i+1 < argc )
+        engineName = argv[++i];
+      else if ( !strcmp(argv[i], "-n") && i+1 < argc )
+        repeats = atoi(argv[++i]);
+      else if ( !strcmp(argv[i], "-o") && i+1 < argc )
+        outName = argv[++i];
+      else if ( argv[i][0] == '-' )
+      {
+        usage();
+        return 1;
+      }
+      else
+        fnames.push_back(argv[i]);
+    }
+
+    TriangulationEngine_shared engine = iEngine::create(engineName);
+    if ( !engine || fnames.empty() || repeats < 1 )
+    {
+      usage();
+      return 1;
+    }
+
+    ptree results, inputs;
+    results.put("engine", engineName);
+    results.put("repeats", repeats);
+
+    BoundaryReader reader(fnames);
+    BoundaryHole hole;
+    bool failed = false;
+    while ( reader.next(hole) )
+    {
+      std::ostringstream name;
+      name << hole.source_ << "#" << hole.index_;
+
+      std::vector<Samples> all;
+      size_t trianglesN = 0;
+      long long peakBytes = 0;
+
+      try
+      {
+        for (int r = 0; r < repeats; ++r)
+        {
+          typedef boost::chrono::steady_clock clock;
+          clock::time_point start = clock::now();
+
+          Vertices verts(hole.verts_);
+          Triangles tris;
+          TriangulationStats stats;
+          engine->triangulate(verts, tris, &stats);
+
+          samples(all, "total").values_.push_back( boost::chrono::duration<double>(clock::now() - start).count() );
+
+          for (size_t i = 0; i < stats.stages_.size(); ++i)
+          {
+            const StageStats & stage = stats.stages_[i];
+            samples(all, "stage " + stage.name_).values_.push_back(stage.seconds_);
+            if ( iAlloc::tracking() )
+            {
+              samples(all, "stage " + stage.name_ + " allocs", "allocs").values_.push_back((double)stage.alloc_.allocs_);
+              samples(all, "stage " + stage.name_ + " bytes", "bytes").values_.push_back((double)stage.alloc_.bytes_);
+            }
+          }
+
+          trianglesN = tris.size();
+          peakBytes = stats.peakBytes_;
+        }
+      }
+      catch ( std::exception & e )
+      {
+        std::cerr << name.str() << ": " << e.what() << "\n";
+        failed = true;
+        continue;
+      }
+
+      ptree input, metrics;
+      input.put("name", name.str());
+      input.put("points", hole.verts_.size());
+      input.put("triangles", trianglesN);
+      if ( iAlloc::tracking() )
+        input.put("peak_bytes", peakBytes);
+
+      for (size_t i = 0; i < all.size(); ++i)
+        all[i].write(metrics);
+
+      input.add_child("metrics", metrics);
+      inputs.push_back(std::make_pair("", input));
+
+      std::cerr << name.str() << "\n";
+    }
+
+    results.add_child("inputs", inputs);
+
+    if ( outName )
+    {
+      std::ofstream ofs(outName);
+      if ( !ofs )
+      {
+        std::cerr << "can't write " << outName << "\n";
+        return 1;
+      }
+      boost::property_tree::write_json(ofs, results);
+    }
+    else
+      boost::property_tree::write_json(std::cout, results);
+
+    return failed ? 2 : 0;
+  }
+
+  //////////////////////////////////////////////////////////////////////////
+  const ptree * findChild(const ptree & array, const std::string & name)
+  {
+    for (ptree::const_iterator i = array.begin(); i != array.end(); ++i)
+    {
+      if ( i->second.get<std::string>("name", "") == name )
+        return &i->second;
+    }
+    return 0;
+  }
+
+  int compare(int argc, char * argv[])
+  {
+    double tolerance = 0.05, sigmas = 3, floor = 0.001;
+    std::vector<std::string> fnames;
+
+    for (int i = 0; i < argc; ++i)
+    {
+      if ( !strcmp(argv[i], "-t") && i+1 < argc )
+        tolerance = atof(argv[++i]);
+      else if ( !strcmp(argv[i], "-k") && i+1 < argc )
+        sigmas = atof(argv[++i]);
+      else if ( !strcmp(argv[i], "-f") && i+1 < argc )
+        floor = atof(argv[++i]);
+      else if ( argv[i][0] == '-' )
+      {
+        usage();
+        return 1;
+      }
+      else
+        fnames.push_back(argv[i]);
+    }
+
+    if ( fnames.size() != 2 )
+    {
+      usage();
+      return 1;
+    }
+
+    ptree base, curr;
+    try
+    {
+      boost::property_tree::read_json(fnames[0], base);
+      boost::property_tree::read_json(fnames[1], curr);
+    }
+    catch ( std::exception & e )
+    {
+      std::cerr << e.what() << "\n";
+      return 1;
+    }
+
+    const ptree empty;
+    size_t regressionsN = 0, comparedN = 0, missingN = 0, changedN = 0;
+    const ptree & baseInputs = base.get_child("inputs", empty);
+    const ptree & currInputs = curr.get_child("inputs", empty);
+    for (ptree::const_iterator i = baseInputs.begin(); i != baseInputs.end(); ++i)
+    {
+      const ptree & bi = i->second;
+      std::string name = bi.get<std::string>("name", "");
+      const ptree * ci = findChild(currInputs, name);
+      if ( !ci )
+      {
+        std::cout << name << ": missing in results\n";
+        missingN++;
+        continue;
+      }
+
+      if ( bi.get<size_t>("triangles", 0) != ci->get<size_t>("triangles", 0) )
+      {
+        std::cout << name << ": triangles " << bi.get<size_t>("triangles", 0)
+          << " -> " << ci->get<size_t>("triangles", 0) << ", output changed\n";
+        changedN++;
+      }
+
+      const ptree & bm = bi.get_child("metrics", empty);
+      const ptree & cm = ci->get_child("metrics", empty);
+      for (ptree::const_iterator j = bm.begin(); j != bm.end(); ++j)
+      {
+        std::string metric = j->second.get<std::string>("name", "");
+        const ptree * m = findChild(cm, metric);
+        if ( !m )
+          continue;
+
+        double b = j->second.get<double>("mean", 0), bs = j->second.get<double>("stddev", 0);
+        double c = m->get<double>("mean", 0), cs = m->get<double>("stddev", 0);
+        std::string unit = j->second.get<std::string>("unit", "s");
+        bool seconds = unit == "s";
+        if ( seconds ? b < floor : b <= 0 )
+          continue;
+
+        comparedN++;
+
+        // slower or bigger by more than tolerance and than the noise of both runs
+        double noise = sigmas * sqrt(bs*bs + cs*cs);
+        double limit = std::max(b*tolerance, noise);
+        if ( c - b <= limit )
+          continue;
+
+        regressionsN++;
+        double scale = seconds ? 1e3 : 1;
+        if ( seconds )
+          unit = "ms";
+        std::cout << name << ": " << metric << " " << b*scale << " -> " << c*scale << " " << unit << " (+"
+          << (c/b - 1)*100 << "%, limit " << limit*scale << " " << unit << ")\n";
+      }
+    }
+
+    std::cout << comparedN << " metrics compared, " << regressionsN << " regressions, "
+      << missingN << " inputs missing, " << changedN << " outputs changed\n";
+    return regressionsN + missingN + changedN > 0 ? 2 : 0;
+  }
+}
+
+int main(int argc, char * argv[])
+{
+  if ( argc < 2 )
+  {
+    usage();
+    return 1;
+  }
+
+  if ( !strcmp(argv[1], "run") )
+    return run(argc-2, argv+2);
+
+  if ( !strcmp(argv[1], "compare") )
+    return compare(argc-2, argv+2);
+
+  usage();
+  return 1;
+}
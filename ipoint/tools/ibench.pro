@@ -0,0 +1,14 @@
+TEMPLATE = app
+TARGET = ibench
+CONFIG += console
+CONFIG -= qt app_bundle
+
+include(../core.pri)
+
+SOURCES += ibench.cpp
+
+CONFIG(debug, debug|release) {
+    DESTDIR = ../../build/debug
+} else {
+    DESTDIR = ../../build/release
+}
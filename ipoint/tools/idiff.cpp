@@ -0,0 +1,243 @@
+#include "engine.h"
+#include "meshcheck.h"
+#include "pipeline.h"
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <math.h>
+
+// idiff [-a engine] [-b engine] [-v] boundary files...
+static void usage()
+{
+  std::vector<std::string> names;
+  iEngine::names(names);
+
+  std::cerr << "usage: idiff [-a engine] [-b engine] [-v] boundary files...\n";
+  std::cerr << "  runs both engines on every hole, checks both meshes and compares triangle sets\n";
+  std::cerr << "  -a  first engine, reference by default\n";
+  std::cerr << "  -b  second engine, default by default\n";
+  std::cerr << "  -v  print triangles found in one mesh only\n";
+  std::cerr << "  engines:";
+  for (size_t i = 0; i < names.size(); ++i)
+    std::cerr << " " << names[i];
+  std::cerr << "\n";
+}
+
+namespace
+{
+  // boundary vertices are compared by index, inner ones by position
+  struct VertexKey
+  {
+    int index_;
+    long long x_, y_, z_;
+
+    bool operator < (const VertexKey & k) const
+    {
+      if ( index_ != k.index_ )
+        return index_ < k.index_;
+      if ( x_ != k.x_ )
+        return x_ < k.x_;
+      if ( y_ != k.y_ )
+        return y_ < k.y_;
+      return z_ < k.z_;
+    }
+
+    bool operator == (const VertexKey & k) const
+    {
+      return !(*this < k) && !(k < *this);
+    }
+  };
+
+  // vertices from the smallest, orientation is kept
+  struct TriangleKey
+  {
+    VertexKey v_[3];
+
+    bool operator < (const TriangleKey & k) const
+    {
+      for (int i = 0; i < 3; ++i)
+      {
+        if ( v_[i] < k.v_[i] )
+          return true;
+        if ( k.v_[i] < v_[i] )
+          return false;
+      }
+      return false;
+    }
+  };
+
+  void canonical(const Vertices & verts, size_t boundaryN, const Triangles & tris, double quantum, std::vector<TriangleKey> & keys)
+  {
+    keys.resize(tris.size());
+    for (size_t i = 0; i < tris.size(); ++i)
+    {
+      VertexKey v[3];
+      for (int j = 0; j < 3; ++j)
+      {
+        int index = tris[i].v[j];
+        const Vec3f & p = verts[index].p();
+        bool boundary = index < (int)boundaryN;
+        v[j].index_ = boundary ? index : -1;
+        v[j].x_ = boundary ? 0 : (long long)floor(p.x/quantum + 0.5);
+        v[j].y_ = boundary ? 0 : (long long)floor(p.y/quantum + 0.5);
+        v[j].z_ = boundary ? 0 : (long long)floor(p.z/quantum + 0.5);
+      }
+
+      int first = 0;
+      for (int j = 1; j < 3; ++j)
+      {
+        if ( v[j] < v[first] )
+          first = j;
+      }
+
+      for (int j = 0; j < 3; ++j)
+        keys[i].v_[j] = v[(first + j) % 3];
+    }
+
+    std::sort(keys.begin(), keys.end());
+  }
+
+  void writeKey(std::ostream & os, const TriangleKey & key, double quantum)
+  {
+    for (int i = 0; i < 3; ++i)
+    {
+      const VertexKey & v = key.v_[i];
+      if ( v.index_ >= 0 )
+        os << " " << v.index_;
+      else
+        os << " (" << v.x_*quantum << ", " << v.y_*quantum << ", " << v.z_*quantum << ")";
+    }
+    os << "\n";
+  }
+
+  struct Result
+  {
+    Result() : ok_(false) {}
+
+    bool ok_;
+    std::string error_;
+    Vertices verts_;
+    Triangles tris_;
+    MeshCheck check_;
+  };
+
+  void run(TriangulationEngine & engine, const BoundaryHole & hole, Result & result)
+  {
+    result.verts_ = hole.verts_;
+    try
+    {
+      engine.triangulate(result.verts_, result.tris_, 0);
+      iMesh::checkMesh(hole.verts_, result.verts_, result.tris_, result.check_);
+      result.ok_ = true;
+    }
+    catch ( std::exception & e )
+    {
+      result.error_ = e.what();
+    }
+  }
+}
+
+int main(int argc, char * argv[])
+{
+  std::string nameA = "reference", nameB = "default";
+  bool verbose = false;
+  std::vector<std::string> fnames;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    if ( !strcmp(argv[i], "-a") && i+1 < argc )
+      nameA = argv[++i];
+    else if ( !strcmp(argv[i], "-b") && i+1 < argc )
+      nameB = argv[++i];
+    else if ( !strcmp(argv[i], "-v") )
+      verbose = true;
+    else if ( argv[i][0] == '-' )
+    {
+      usage();
+      return 1;
+    }
+    else
+      fnames.push_back(argv[i]);
+  }
+
+  TriangulationEngine_shared engineA = iEngine::create(nameA);
+  TriangulationEngine_shared engineB = iEngine::create(nameB);
+  if ( !engineA || !engineB || fnames.empty() )
+  {
+    usage();
+    return 1;
+  }
+
+  BoundaryReader reader(fnames);
+  BoundaryHole hole;
+  size_t holesN = 0, divergedN = 0;
+  while ( reader.next(hole) )
+  {
+    holesN++;
+    std::cout << hole.source_ << "#" << hole.index_ << ":\n";
+
+    Result a, b;
+    run(*engineA, hole, a);
+    run(*engineB, hole, b);
+
+    bool same = a.ok_ && b.ok_ && a.check_.valid() && b.check_.valid();
+
+    const Result * results[2] = { &a, &b };
+    const std::string * names[2] = { &nameA, &nameB };
+    for (int i = 0; i < 2; ++i)
+    {
+      const Result & r = *results[i];
+      std::cout << "  " << *names[i] << ": ";
+      if ( r.ok_ )
+      {
+        std::cout << r.tris_.size() << " triangles, " << r.verts_.size() << " points, ";
+        iMesh::writeCheck(std::cout, r.check_);
+      }
+      else
+        std::cout << "failed, " << r.error_;
+      std::cout << "\n";
+    }
+
+    if ( a.ok_ && b.ok_ )
+    {
+      // inner points closer than this are the same point
+      Rect3f rect;
+      for (size_t i = 0; i < hole.verts_.size(); ++i)
+        rect.add(hole.verts_[i].p());
+      double quantum = std::max(rect.diagonal().length(), 1e-10) * 1e-9;
+
+      std::vector<TriangleKey> ka, kb, onlyA, onlyB;
+      canonical(a.verts_, hole.verts_.size(), a.tris_, quantum, ka);
+      canonical(b.verts_, hole.verts_.size(), b.tris_, quantum, kb);
+      std::set_difference(ka.begin(), ka.end(), kb.begin(), kb.end(), std::back_inserter(onlyA));
+      std::set_difference(kb.begin(), kb.end(), ka.begin(), ka.end(), std::back_inserter(onlyB));
+
+      if ( onlyA.empty() && onlyB.empty() )
+        std::cout << "  same triangles\n";
+      else
+      {
+        same = false;
+        std::cout << "  diverged: " << onlyA.size() << " triangles only in " << nameA << ", "
+          << onlyB.size() << " only in " << nameB << "\n";
+
+        for (size_t i = 0; verbose && i < onlyA.size(); ++i)
+        {
+          std::cout << "    " << nameA << ":";
+          writeKey(std::cout, onlyA[i], quantum);
+        }
+        for (size_t i = 0; verbose && i < onlyB.size(); ++i)
+        {
+          std::cout << "    " << nameB << ":";
+          writeKey(std::cout, onlyB[i], quantum);
+        }
+      }
+    }
+
+    if ( !same )
+      divergedN++;
+  }
+
+  std::cout << holesN << " holes, " << divergedN << " diverged or invalid\n";
+  return divergedN > 0 ? 2 : 0;
+}
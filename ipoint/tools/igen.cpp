@@ -0,0 +1,98 @@
+#include "boundgen.h"
+#include "meshio.h"
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+#include <cstring>
+#include <math.h>
+
+// igen [-n points] [-m holes] [-g growth] [-e noise] [-c curvature] [-s turns] [-k channels] [-w width] [-l runs] [-r seed] [-o output]
+static void usage()
+{
+  std::cerr << "usage: igen [-n points] [-m holes] [-g growth] [-e noise] [-c curvature] [-s turns] [-k channels] [-w width] [-l runs] [-r seed] [-o output]\n";
+  std::cerr << "  -n  points in the first hole, 1000 by default\n";
+  std::cerr << "  -m  number of holes, 1 by default\n";
+  std::cerr << "  -g  each next hole has this many times more points, 1 by default\n";
+  std::cerr << "  -e  random shift of points across boundary, in edge lengths\n";
+  std::cerr << "  -c  curvature of the surface boundary lies on\n";
+  std::cerr << "  -s  spiral arm with given number of turns instead of star shaped loop\n";
+  std::cerr << "  -k  narrow channels cut into star shaped loop\n";
+  std::cerr << "  -w  channels width relative to loop radius, 0.05 by default. should be a few edges wide\n";
+  std::cerr << "  -l  straight runs of near collinear points\n";
+  std::cerr << "  -r  random seed, hole i uses seed+i\n";
+}
+
+int main(int argc, char * argv[])
+{
+  iGen::LoopParams params;
+  int holesN = 1;
+  double growth = 1;
+  const char * outName = 0;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    if ( !strcmp(argv[i], "-n") && i+1 < argc )
+      params.points_ = atoi(argv[++i]);
+    else if ( !strcmp(argv[i], "-m") && i+1 < argc )
+      holesN = atoi(argv[++i]);
+    else if ( !strcmp(argv[i], "-g") && i+1 < argc )
+      growth = atof(argv[++i]);
+    else if ( !strcmp(argv[i], "-e") && i+1 < argc )
+      params.noise_ = atof(argv[++i]);
+    else if ( !strcmp(argv[i], "-c") && i+1 < argc )
+      params.curvature_ = atof(argv[++i]);
+    else if ( !strcmp(argv[i], "-s") && i+1 < argc )
+      params.spiral_ = atoi(argv[++i]);
+    else if ( !strcmp(argv[i], "-k") && i+1 < argc )
+      params.channels_ = atoi(argv[++i]);
+    else if ( !strcmp(argv[i], "-w") && i+1 < argc )
+      params.channelWidth_ = atof(argv[++i]);
+    else if ( !strcmp(argv[i], "-l") && i+1 < argc )
+      params.collinear_ = atoi(argv[++i]);
+    else if ( !strcmp(argv[i], "-r") && i+1 < argc )
+      params.seed_ = atoi(argv[++i]);
+    else if ( !strcmp(argv[i], "-o") && i+1 < argc )
+      outName = argv[++i];
+    else
+    {
+      usage();
+      return 1;
+    }
+  }
+
+  if ( params.points_ < 3 || holesN < 1 || growth <= 0 )
+  {
+    usage();
+    return 1;
+  }
+
+  std::ofstream ofs;
+  if ( outName )
+  {
+    ofs.open(outName);
+    if ( !ofs )
+    {
+      std::cerr << "can't write " << outName << "\n";
+      return 1;
+    }
+  }
+
+  std::ostream & os = outName ? ofs : std::cout;
+
+  // edges get short on big holes
+  os.precision(12);
+
+  size_t pointsN = params.points_;
+  unsigned seed = params.seed_;
+  for (int i = 0; i < holesN; ++i)
+  {
+    params.points_ = (size_t)(pointsN * pow(growth, i) + 0.5);
+    params.seed_ = seed + i;
+
+    Vertices verts;
+    iGen::generateLoop(params, verts);
+    iMeshIO::writeBoundary(os, verts);
+  }
+
+  return 0;
+}
@@ -0,0 +1,17 @@
+TEMPLATE = app
+TARGET = igen
+CONFIG += console
+CONFIG -= qt app_bundle
+
+include(../core.pri)
+
+HEADERS += boundgen.h
+
+SOURCES += boundgen.cpp \
+           igen.cpp
+
+CONFIG(debug, debug|release) {
+    DESTDIR = ../../build/debug
+} else {
+    DESTDIR = ../../build/release
+}
@@ -0,0 +1,279 @@
+#include "imath.h"
+#include "oredge.h"
+#include "octree.h"
+#include "meshio.h"
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstring>
+#include <boost/chrono.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+#include <boost/random/uniform_real_distribution.hpp>
+
+// imicro [-t ms] [-r repeats] [boundary file]
+static void usage()
+{
+  std::cerr << "usage: imicro [-t ms] [-r repeats] [boundary file]\n";
+  std::cerr << "  -t  minimal time of one measurement, 200 ms by default\n";
+  std::cerr << "  -r  measurements per kernel, the best one is reported. 5 by default\n";
+  std::cerr << "  kernels are run on random points and on the first hole of boundary file if given\n";
+}
+
+namespace
+{
+  const size_t samplesN = 4096;
+
+  // keeps results alive so the compiler doesn't throw calls away
+  volatile double sink_ = 0;
+
+  // inputs of one call. points are taken from the same small neighborhood for real geometry
+  struct Sample
+  {
+    Vec3f p[5];
+    Rect3f r0, r1;
+  };
+
+  struct Inputs
+  {
+    Inputs() : container_(verts_) {}
+
+    std::string name_;
+    Vertices verts_;
+    EdgesContainer container_;
+    boost::shared_ptr< OcTree<OrEdge> > octree_;
+    std::vector<Sample> samples_;
+  };
+
+  void makeSamples(Inputs & in, boost::random::mt19937 & rng, size_t span)
+  {
+    size_t n = in.verts_.size();
+    boost::random::uniform_int_distribution<size_t> first(0, n-1), offset(2, span);
+
+    in.samples_.resize(samplesN);
+    for (size_t i = 0; i < samplesN; ++i)
+    {
+      Sample & s = in.samples_[i];
+      size_t k = first(rng), m = offset(rng);
+      s.p[0] = in.verts_[k].p();
+      s.p[1] = in.verts_[(k+1) % n].p();
+      s.p[2] = in.verts_[(k+2) % n].p();
+      s.p[3] = in.verts_[(k+m) % n].p();
+      s.p[4] = in.verts_[(k+m+1) % n].p();
+
+      s.r0.makeInvalid();
+      s.r0.add(s.p[0]);
+      s.r0.add(s.p[1]);
+
+      s.r1.makeInvalid();
+      s.r1.add(s.p[3]);
+      s.r1.add(s.p[4]);
+    }
+
+    // index the closed loop the way triangulation does
+    Rect3f rc;
+    for (size_t i = 0; i < n; ++i)
+      rc.add(in.verts_[i].p());
+
+    in.octree_.reset( new OcTree<OrEdge>(rc, 5) );
+    for (size_t i = 0; i < n; ++i)
+      in.octree_->add( in.container_.new_edge((int)i, (int)((i+1) % n)) );
+  }
+
+  // random walk, so edges are short compared to the whole set as in real boundaries
+  // but neighbor edges have no common plane or direction
+  void makeRandom(Inputs & in, boost::random::mt19937 & rng, size_t pointsN)
+  {
+    boost::random::uniform_real_distribution<double> step(-0.05, 0.05);
+
+    in.name_ = "random";
+    in.verts_.resize(pointsN);
+    Vec3f p(0, 0, 0);
+    for (size_t i = 0; i < pointsN; ++i)
+    {
+      in.verts_[i] = Vertex(p, Vec3f(0, 0, 1));
+      p += Vec3f(step(rng), step(rng), step(rng));
+    }
+
+    makeSamples(in, rng, 16);
+  }
+
+  bool readData(Inputs & in, boost::random::mt19937 & rng, const char * fname)
+  {
+    std::ifstream ifs(fname);
+    if ( !ifs || !iMeshIO::readBoundary(ifs, in.verts_) || in.verts_.size() < 20 )
+      return false;
+
+    in.name_ = "data";
+    makeSamples(in, rng, 16);
+    return true;
+  }
+
+  //////////////////////////////////////////////////////////////////////////
+  // kernels, one call per sample
+  struct EdgesIsect
+  {
+    double operator () (const Sample & s) const
+    {
+      Vec3f r;
+      double dist = 0;
+      return iMath::edges_isect(s.p[0], s.p[1], s.p[3], s.p[4], r, dist) ? dist : 0;
+    }
+  };
+
+  struct EdgeTriIsect
+  {
+    double operator () (const Sample & s) const
+    {
+      Vec3f ip;
+      return iMath::edge_tri_isect(s.p[3], s.p[4], s.p[0], s.p[1], s.p[2], ip) ? ip.x : 0;
+    }
+  };
+
+  struct DistToLine
+  {
+    double operator () (const Sample & s) const
+    {
+      bool outside = false;
+      Vec3f d = iMath::dist_to_line(s.p[0], s.p[1], s.p[3], outside);
+      return outside ? 0 : d.x;
+    }
+  };
+
+  struct InsideTri
+  {
+    double operator () (const Sample & s) const
+    {
+      return iMath::inside_tri(s.p[0], s.p[1], s.p[2], s.p[3]) ? 1 : 0;
+    }
+  };
+
+  struct SinCos
+  {
+    double operator () (const Sample & s) const
+    {
+      double sa, ca;
+      iMath::sincos(s.p[0], s.p[1], sa, ca);
+      return sa + ca;
+    }
+  };
+
+  struct RectsIntersecting
+  {
+    double operator () (const Sample & s) const
+    {
+      return s.r0.intersecting(s.r1) ? 1 : 0;
+    }
+  };
+
+  struct OcTreeCollect
+  {
+    OcTreeCollect(OcTree<OrEdge> & octree) : octree_(octree) {}
+
+    double operator () (const Sample & s) const
+    {
+      std::set<const OrEdge*> items;
+      octree_.collect(s.r0, items);
+      return (double)items.size();
+    }
+
+    OcTree<OrEdge> & octree_;
+  };
+
+  //////////////////////////////////////////////////////////////////////////
+  template <class Kernel>
+  void bench(const char * name, const Inputs & in, Kernel kernel, double minSeconds, int repeats)
+  {
+    typedef boost::chrono::steady_clock clock;
+
+    // samples passes per measurement, doubled until it takes long enough
+    size_t passes = 1;
+    double best = 0;
+    for (int rep = 0; rep < repeats; )
+    {
+      double sum = 0;
+      clock::time_point start = clock::now();
+      for (size_t p = 0; p < passes; ++p)
+      {
+        for (size_t i = 0; i < in.samples_.size(); ++i)
+          sum += kernel(in.samples_[i]);
+      }
+      double seconds = boost::chrono::duration<double>(clock::now() - start).count();
+      sink_ = sink_ + sum;
+
+      if ( seconds < minSeconds )
+      {
+        passes *= 2;
+        continue;
+      }
+
+      double ns = seconds * 1e9 / (passes * in.samples_.size());
+      if ( rep == 0 || ns < best )
+        best = ns;
+      rep++;
+    }
+
+    std::cout << std::left << std::setw(22) << name << std::setw(8) << in.name_ << std::right
+      << std::fixed << std::setprecision(2) << std::setw(12) << best
+      << std::setprecision(2) << std::setw(14) << 1e3 / best << "\n";
+  }
+
+  void benchAll(Inputs & in, double minSeconds, int repeats)
+  {
+    bench("edges_isect", in, EdgesIsect(), minSeconds, repeats);
+    bench("edge_tri_isect", in, EdgeTriIsect(), minSeconds, repeats);
+    bench("dist_to_line", in, DistToLine(), minSeconds, repeats);
+    bench("inside_tri", in, InsideTri(), minSeconds, repeats);
+    bench("sincos", in, SinCos(), minSeconds, repeats);
+    bench("Rect3f::intersecting", in, RectsIntersecting(), minSeconds, repeats);
+    bench("OcTree::collect", in, OcTreeCollect(*in.octree_), minSeconds, repeats);
+  }
+}
+
+int main(int argc, char * argv[])
+{
+  double minSeconds = 0.2;
+  int repeats = 5;
+  const char * fname = 0;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    if ( !strcmp(argv[i], "-t") && i+1 < argc )
+      minSeconds = atof(argv[++i]) * 1e-3;
+    else if ( !strcmp(argv[i], "-r") && i+1 < argc )
+      repeats = atoi(argv[++i]);
+    else if ( argv[i][0] == '-' || fname )
+    {
+      usage();
+      return 1;
+    }
+    else
+      fname = argv[i];
+  }
+
+  if ( repeats < 1 )
+    repeats = 1;
+
+  // fixed seed, inputs are the same from run to run
+  boost::random::mt19937 rng(12345);
+
+  Inputs random;
+  makeRandom(random, rng, 1024);
+
+  Inputs data;
+  if ( fname && !readData(data, rng, fname) )
+  {
+    std::cerr << "can't read boundary from " << fname << "\n";
+    return 1;
+  }
+
+  std::cout << std::left << std::setw(22) << "kernel" << std::setw(8) << "input" << std::right
+    << std::setw(12) << "ns/call" << std::setw(14) << "Mcalls/s" << "\n";
+
+  benchAll(random, minSeconds, repeats);
+  if ( fname )
+    benchAll(data, minSeconds, repeats);
+
+  return 0;
+}
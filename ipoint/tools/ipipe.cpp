@@ -0,0 +1,144 @@
+#include "pipeline.h"
+#include "iprofile.h"
+#include "engine.h"
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+#include <cstring>
+#include <boost/thread/thread.hpp>
+
+// ipipe [-j threads] [-w threads] [-q in-flight] [-c] [-r] [-s stats] [-p] [-i] [-m] [-f] [-t trace] [-o output] boundary files...
+static void usage()
+{
+  std::cerr << "usage: ipipe [-j threads] [-w threads] [-q in-flight holes] [-n smooth iterations] [-l fairing order] [-c] [-r] [-s stats] [-p] [-i] [-m] [-f] [-t trace] [-o output] boundary files...\n";
+  std::cerr << "  -w  worker threads inside one hole, 1 by default\n";
+  std::cerr << "  -n  smoothing iterations at most, 2 by default\n";
+  std::cerr << "  -l  fair instead of smoothing, 1 by Laplacian, 2 by bi-Laplacian\n";
+  std::cerr << "  -c  order triangles for vertex cache\n";
+  std::cerr << "  -r  renumber inner vertices in order of use\n";
+  std::cerr << "  -s  write per hole statistics to file\n";
+  std::cerr << "  -p  sample hardware counters per stage into statistics\n";
+  std::cerr << "  -i  add spatial index diagnostics to statistics\n";
+  std::cerr << "  -m  add mesh quality to statistics\n";
+  std::cerr << "  -f  all optimizations changing the triangulation, see iEngine::enableOptimizations\n";
+  std::cerr << "  -t  write chrome trace events to file, needs USE_TRACE_EVENTS build\n";
+}
+
+int main(int argc, char * argv[])
+{
+  size_t threadsN = boost::thread::hardware_concurrency();
+  size_t inFlightMax = 0;
+  const char * outName = 0;
+  const char * statsName = 0;
+  const char * traceName = 0;
+  std::vector<std::string> fnames;
+  TriangulationOptions options;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    if ( !strcmp(argv[i], "-j") && i+1 < argc )
+      threadsN = atoi(argv[++i]);
+    else if ( !strcmp(argv[i], "-w") && i+1 < argc )
+      options.threads_ = atoi(argv[++i]);
+    else if ( !strcmp(argv[i], "-q") && i+1 < argc )
+      inFlightMax = atoi(argv[++i]);
+    else if ( !strcmp(argv[i], "-n") && i+1 < argc )
+      options.smoothIterations_ = atoi(argv[++i]);
+    else if ( !strcmp(argv[i], "-l") && i+1 < argc )
+      options.fairing_ = atoi(argv[++i]);
+    else if ( !strcmp(argv[i], "-c") )
+      options.optimizeOrder_ = true;
+    else if ( !strcmp(argv[i], "-r") )
+      options.renumberVertices_ = true;
+    else if ( !strcmp(argv[i], "-p") )
+      options.perfCounters_ = true;
+    else if ( !strcmp(argv[i], "-i") )
+      options.indexDiagnostics_ = true;
+    else if ( !strcmp(argv[i], "-m") )
+      options.meshQuality_ = true;
+    else if ( !strcmp(argv[i], "-f") )
+      iEngine::enableOptimizations(options);
+    else if ( !strcmp(argv[i], "-o") && i+1 < argc )
+      outName = argv[++i];
+    else if ( !strcmp(argv[i], "-s") && i+1 < argc )
+      statsName = argv[++i];
+    else if ( !strcmp(argv[i], "-t") && i+1 < argc )
+      traceName = argv[++i];
+    else if ( argv[i][0] == '-' )
+    {
+      usage();
+      return 1;
+    }
+    else
+      fnames.push_back(argv[i]);
+  }
+
+  if ( fnames.empty() )
+  {
+    usage();
+    return 1;
+  }
+
+  for (size_t i = 0; i < fnames.size(); ++i)
+  {
+    std::ifstream ifs(fnames[i].c_str());
+    if ( !ifs )
+    {
+      std::cerr << "can't open " << fnames[i] << "\n";
+      return 1;
+    }
+  }
+
+  if ( threadsN < 1 )
+    threadsN = 1;
+
+  // keep every worker busy while the slowest hole blocks the output
+  if ( inFlightMax < 1 )
+    inFlightMax = threadsN*2;
+
+  std::ofstream ofs;
+  if ( outName )
+  {
+    ofs.open(outName);
+    if ( !ofs )
+    {
+      std::cerr << "can't write " << outName << "\n";
+      return 1;
+    }
+  }
+
+  std::ofstream sfs;
+  if ( statsName )
+  {
+    sfs.open(statsName);
+    if ( !sfs )
+    {
+      std::cerr << "can't write " << statsName << "\n";
+      return 1;
+    }
+  }
+
+  BoundaryReader reader(fnames);
+  MeshWriter writer(outName ? ofs : std::cout);
+  TriangulationPipeline pipeline(threadsN, inFlightMax, options);
+
+  if ( traceName )
+    iProfile::startTrace();
+
+  pipeline.run(reader, writer, &std::cerr, statsName ? &sfs : 0);
+
+  if ( traceName )
+  {
+    iProfile::stopTrace();
+    std::ofstream tfs(traceName);
+    iProfile::writeTrace(tfs);
+  }
+
+  std::cerr << pipeline.holesCount() << " holes, " << pipeline.failedCount() << " failed, "
+    << pipeline.trianglesCount() << " triangles\n";
+
+  // empty unless built with USE_STAGE_TIMERS
+  iProfile::writeTimers(std::cerr);
+
+  return pipeline.failedCount() ? 2 : 0;
+}
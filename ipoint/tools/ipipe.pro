@@ -0,0 +1,14 @@
+TEMPLATE = app
+TARGET = ipipe
+CONFIG += console
+CONFIG -= qt app_bundle
+
+include(../core.pri)
+
+SOURCES += ipipe.cpp
+
+CONFIG(debug, debug|release) {
+    DESTDIR = ../../build/debug
+} else {
+    DESTDIR = ../../build/release
+}
@@ -0,0 +1,252 @@
+#include "tristats.h"
+#include <ostream>
+#include <iomanip>
+#include <algorithm>
+#include <math.h>
+
+MeshQualityStats::MeshQualityStats()
+{
+  clear();
+}
+
+void MeshQualityStats::clear()
+{
+  triangles_ = 0;
+  std::fill(minAngle_, minAngle_ + AngleBins, 0);
+  std::fill(maxAngle_, maxAngle_ + AngleBins, 0);
+  std::fill(aspect_, aspect_ + AspectBins, 0);
+
+  edges_ = 0;
+  minLength_ = maxLength_ = sumLength_ = sumLength2_ = 0;
+
+  nonDelaunay_ = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+TriangulationStats::TriangulationStats()
+{
+  clear();
+}
+
+void TriangulationStats::clear()
+{
+  planar_ = false;
+  projected_ = false;
+  planarDiagonals_ = 0;
+  earsClipped_ = 0;
+  diagonalsAdded_ = 0;
+  convexAltFallbacks_ = 0;
+  cutsRejected_ = 0;
+  untangleFlips_ = 0;
+  prebuildTasks_ = 0;
+  prebuildSteals_ = 0;
+  prebuildRedone_ = false;
+
+  needRotateCalls_ = 0;
+  rotateRejected_ = 0;
+  flipLoops_.clear();
+  refineRotations_ = 0;
+
+  edgesSplit_ = 0;
+  splitStale_ = 0;
+
+  octreeAdds_ = 0;
+  octreeRemoves_ = 0;
+  octreeCollects_ = 0;
+  octreeCollected_ = 0;
+
+  selfIsectEdge_ = IndexQueryStats();
+  selfIsectTri_ = IndexQueryStats();
+  crossSections_ = IndexQueryStats();
+  octree_.clear();
+
+  smoothIterations_ = 0;
+  smoothMoves_ = 0;
+  fairingIterations_ = 0;
+  fairingUnknowns_ = 0;
+
+  quality_.clear();
+
+  peakBytes_ = 0;
+
+  stages_.clear();
+}
+
+static void writeQuality(std::ostream & os, const MeshQualityStats & quality)
+{
+  if ( quality.triangles_ == 0 )
+    return;
+
+  os << "  min angle histogram:";
+  for (int i = 0; i < MeshQualityStats::AngleBins; ++i)
+  {
+    if ( quality.minAngle_[i] > 0 )
+      os << " " << i*10 << "-" << (i+1)*10 << ":" << quality.minAngle_[i];
+  }
+  os << "\n";
+
+  os << "  max angle histogram:";
+  for (int i = 0; i < MeshQualityStats::AngleBins; ++i)
+  {
+    if ( quality.maxAngle_[i] > 0 )
+      os << " " << i*10 << "-" << (i+1)*10 << ":" << quality.maxAngle_[i];
+  }
+  os << "\n";
+
+  static const char * aspectNames[MeshQualityStats::AspectBins] = { "1-1.5", "1.5-2", "2-3", "3-5", "5-10", ">10" };
+  os << "  aspect ratio histogram:";
+  for (int i = 0; i < MeshQualityStats::AspectBins; ++i)
+    os << " " << aspectNames[i] << ":" << quality.aspect_[i];
+  os << "\n";
+
+  if ( quality.edges_ > 0 )
+  {
+    double mean = quality.sumLength_ / quality.edges_;
+    double var = quality.sumLength2_ / quality.edges_ - mean*mean;
+    os << "  relative edge length: min " << std::fixed << std::setprecision(3) << quality.minLength_
+      << ", max " << quality.maxLength_ << ", mean " << mean << ", stddev " << sqrt(var > 0 ? var : 0) << "\n";
+  }
+
+  os << "  non Delaunay edges: " << quality.nonDelaunay_ << "\n";
+}
+
+void writeStats(std::ostream & os, const TriangulationStats & stats)
+{
+  os << "  planar fast path: " << (stats.planar_ ? "yes" : "no") << "\n";
+  os << "  best-fit plane projection: " << (stats.projected_ ? "yes" : "no") << "\n";
+  if ( stats.planar_ || stats.projected_ )
+    os << "  planar diagonals: " << stats.planarDiagonals_ << "\n";
+  os << "  ears clipped: " << stats.earsClipped_ << "\n";
+  os << "  intruding point diagonals: " << stats.diagonalsAdded_ << "\n";
+  os << "  convex edge fallbacks: " << stats.convexAltFallbacks_ << "\n";
+  os << "  cuts rejected: " << stats.cutsRejected_ << "\n";
+  os << "  untangle flips: " << stats.untangleFlips_ << "\n";
+  if ( stats.prebuildTasks_ )
+    os << "  prebuild tasks: " << stats.prebuildTasks_ << ", stolen " << stats.prebuildSteals_
+      << (stats.prebuildRedone_ ? ", redone on one thread" : "") << "\n";
+
+  os << "  needRotate calls: " << stats.needRotateCalls_ << "\n";
+  os << "  rotations rejected: " << stats.rotateRejected_ << "\n";
+  for (size_t i = 0; i < stats.flipLoops_.size(); ++i)
+  {
+    const FlipLoopStats & loop = stats.flipLoops_[i];
+    os << "  " << (loop.checkSI_ ? "makeDelaunay(SI)" : "makeDelaunay") << " "
+      << (loop.converged_ ? "converged" : "cut off") << " after " << loop.passes_.size() << " passes\n";
+
+    for (size_t j = 0; j < loop.passes_.size(); ++j)
+    {
+      const FlipPassStats & pass = loop.passes_[j];
+      os << "    pass " << j << ": tested " << pass.tested_ << ", flipped " << pass.flipped_
+        << ", rejected by SI " << pass.rejectedSI_ << ", by connection " << pass.rejectedConnection_;
+      if ( pass.revalidated_ )
+        os << ", revalidated " << pass.revalidated_;
+      os << "\n";
+    }
+  }
+  os << "  refinement rotations: " << stats.refineRotations_ << "\n";
+
+  os << "  edges split: " << stats.edgesSplit_ << "\n";
+  if ( stats.splitStale_ )
+    os << "  split queue stale entries: " << stats.splitStale_ << "\n";
+
+  os << "  octree add/remove/collect: " << stats.octreeAdds_ << " / " << stats.octreeRemoves_ << " / " << stats.octreeCollects_ << "\n";
+  os << "  octree items collected: " << stats.octreeCollected_ << "\n";
+
+  dumpIndexDiagnostics(os, stats);
+
+  os << "  smoothing iterations: " << stats.smoothIterations_ << "\n";
+  if ( stats.smoothMoves_ )
+    os << "  smoothing vertex moves: " << stats.smoothMoves_ << "\n";
+  if ( stats.fairingUnknowns_ )
+    os << "  fairing unknowns/iterations: " << stats.fairingUnknowns_ << " / " << stats.fairingIterations_ << "\n";
+
+  writeQuality(os, stats.quality_);
+
+  for (size_t i = 0; i < stats.stages_.size(); ++i)
+  {
+    const StageStats & stage = stats.stages_[i];
+    os << "  stage " << std::left << std::setw(18) << stage.name_ << std::right
+      << std::fixed << std::setprecision(3) << std::setw(10) << stage.seconds_*1e3 << " ms, "
+      << stage.edges_ << " edges";
+
+    const PerfSample & perf = stage.perf_;
+    if ( perf.valid() )
+    {
+      double edges = stage.edges_ > 0 ? (double)stage.edges_ : 1.0;
+      if ( perf[PerfSample::Cycles] > 0 && perf[PerfSample::Instructions] >= 0 )
+        os << ", IPC " << std::setprecision(2) << double(perf[PerfSample::Instructions]) / perf[PerfSample::Cycles];
+      if ( perf[PerfSample::L1Misses] >= 0 )
+        os << ", L1 misses/edge " << std::setprecision(1) << perf[PerfSample::L1Misses] / edges;
+      if ( perf[PerfSample::LLCMisses] >= 0 )
+        os << ", LLC misses/edge " << std::setprecision(1) << perf[PerfSample::LLCMisses] / edges;
+      if ( perf[PerfSample::BranchMisses] >= 0 )
+        os << ", branch misses/edge " << std::setprecision(1) << perf[PerfSample::BranchMisses] / edges;
+    }
+
+    if ( iAlloc::tracking() )
+    {
+      const AllocSample & alloc = stage.alloc_;
+      os << ", " << alloc.allocs_ << " allocs, " << alloc.bytes_/1024 << " KB"
+        << ", peak " << alloc.peak_/1024 << " KB";
+    }
+
+    os << "\n";
+  }
+
+  if ( iAlloc::tracking() )
+    os << "  peak memory: " << stats.peakBytes_/1024 << " KB\n";
+
+  os.unsetf(std::ios::floatfield);
+  os << std::setprecision(6);
+}
+
+static void writeQueries(std::ostream & os, const char * name, const IndexQueryStats & q, bool overlaps)
+{
+  if ( q.queries_ == 0 )
+    return;
+
+  os << "  " << name << " queries: " << q.queries_ << ", hits " << q.hits_
+    << ", candidates/query " << std::fixed << std::setprecision(1) << double(q.candidates_) / q.queries_;
+
+  if ( overlaps && q.candidates_ > 0 )
+    os << ", overlapping " << std::setprecision(1) << 100.0 * q.overlapping_ / q.candidates_ << "%";
+
+  os << "\n";
+}
+
+void dumpIndexDiagnostics(std::ostream & os, const TriangulationStats & stats)
+{
+  const OcTreeDiagnostics & diag = stats.octree_;
+  bool full = !diag.nodesPerLevel_.empty();
+
+  writeQueries(os, "selfIsect(edge)", stats.selfIsectEdge_, full);
+  writeQueries(os, "selfIsect(tri)", stats.selfIsectTri_, full);
+  writeQueries(os, "haveCrossSections", stats.crossSections_, full);
+
+  if ( !full )
+    return;
+
+  os << "  octree nodes per level:";
+  for (size_t i = 0; i < diag.nodesPerLevel_.size(); ++i)
+    os << " " << diag.nodesPerLevel_[i];
+  os << "\n";
+
+  os << "  octree leaf occupancy:";
+  for (size_t i = 0; i < diag.leafOccupancy_.size(); ++i)
+  {
+    if ( i == 0 )
+      os << " 0:";
+    else if ( i == 1 )
+      os << " 1:";
+    else
+      os << " " << (1 << (i-1)) << "-" << (1 << i)-1 << ":";
+    os << diag.leafOccupancy_[i];
+  }
+  os << "\n";
+
+  if ( diag.items_ > 0 )
+  {
+    os << "  octree leaves per edge: " << std::fixed << std::setprecision(2)
+      << double(diag.references_) / diag.items_ << " (" << diag.items_ << " edges)\n";
+  }
+}
@@ -0,0 +1,194 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <iosfwd>
+#include <cstddef>
+#include "perfcounters.h"
+#include "alloctrack.h"
+
+struct StageStats
+{
+  StageStats() : seconds_(0), edges_(0) {}
+
+  std::string name_;
+  double seconds_;
+
+  // edges in mesh after the stage
+  size_t edges_;
+
+  // hardware counters, if requested and available
+  PerfSample perf_;
+
+  // allocations made by the stage. current_ and peak_ are relative to
+  // the footprint before triangulation
+  AllocSample alloc_;
+};
+
+// shape of the tree, see OcTree::diagnostics
+struct OcTreeDiagnostics
+{
+  OcTreeDiagnostics() : references_(0), items_(0) {}
+
+  void clear()
+  {
+    nodesPerLevel_.clear();
+    leafOccupancy_.clear();
+    references_ = items_ = 0;
+  }
+
+  // number of nodes created on each level, root is level 0
+  std::vector<size_t> nodesPerLevel_;
+
+  // leafOccupancy_[0] - empty leaves, leafOccupancy_[k] - leaves holding [2^(k-1), 2^k) items
+  std::vector<size_t> leafOccupancy_;
+
+  // items stored in all leaves and distinct items. their ratio is how many leaves an item lands in
+  size_t references_, items_;
+};
+
+// spatial index queries of one kind
+struct IndexQueryStats
+{
+  IndexQueryStats() : queries_(0), candidates_(0), overlapping_(0), hits_(0) {}
+
+  size_t queries_;
+
+  // edges returned by the index
+  size_t candidates_;
+
+  // candidates whose bounding box really overlaps the query, counted with indexDiagnostics_ only
+  size_t overlapping_;
+
+  // queries that found an intersection
+  size_t hits_;
+};
+
+// quality of the resulting mesh, see TriangulationOptions::meshQuality_
+struct MeshQualityStats
+{
+  // 10 degrees bins for angles, aspect ratio bins bounds are 1.5, 2, 3, 5, 10
+  enum { AngleBins = 18, AspectBins = 6 };
+
+  MeshQualityStats();
+
+  void clear();
+
+  size_t triangles_;
+  size_t minAngle_[AngleBins];
+  size_t maxAngle_[AngleBins];
+
+  // longest edge to inscribed circle ratio, 1 for equilateral triangle
+  size_t aspect_[AspectBins];
+
+  // edges lengths relative to mean boundary edge length
+  size_t edges_;
+  double minLength_, maxLength_, sumLength_, sumLength2_;
+
+  // inner edges not satisfying Delaunay criterion
+  size_t nonDelaunay_;
+};
+
+// one pass of makeDelaunay over all inner edges
+struct FlipPassStats
+{
+  FlipPassStats() : tested_(0), flipped_(0), rejectedSI_(0), rejectedConnection_(0), revalidated_(0) {}
+
+  size_t tested_;
+  size_t flipped_;
+
+  // flips not made because new edge would intersect the mesh
+  size_t rejectedSI_;
+
+  // flips not made because new edge already exists
+  size_t rejectedConnection_;
+
+  // speculative results tested again because earlier flips changed their neighbourhood
+  size_t revalidated_;
+};
+
+// one makeDelaunayRep call
+struct FlipLoopStats
+{
+  FlipLoopStats() : checkSI_(false), converged_(false) {}
+
+  bool checkSI_;
+
+  // false if stopped by passes count cutoff
+  bool converged_;
+
+  std::vector<FlipPassStats> passes_;
+};
+
+// counters of what DelaunayTriangulator did
+struct TriangulationStats
+{
+  TriangulationStats();
+
+  void clear();
+
+  // prebuild
+  // boundary was flat and triangulated in its plane
+  bool planar_;
+  // boundary was triangulated in its best-fit plane
+  bool projected_;
+  // inner edges made by the planar triangulation
+  size_t planarDiagonals_;
+  size_t earsClipped_;
+  size_t diagonalsAdded_;
+  size_t convexAltFallbacks_;
+  // cuts leaving triangles crossing the mesh or without area, another vertex was cut instead
+  size_t cutsRejected_;
+  // edges of crossing triangles rotated, see DelaunayTriangulator::untangle
+  size_t untangleFlips_;
+  // sub-polygons processed as pool tasks and taken by other workers
+  size_t prebuildTasks_;
+  size_t prebuildSteals_;
+  // diagonals of different tasks crossed each other, prebuild was redone on one thread
+  bool prebuildRedone_;
+
+  // edges flipping
+  size_t needRotateCalls_;
+  size_t rotateRejected_;
+  std::vector<FlipLoopStats> flipLoops_;
+  size_t refineRotations_;
+
+  // refinement
+  size_t edgesSplit_;
+  // split queue entries dropped or requeued because edge was changed after it was queued
+  size_t splitStale_;
+
+  // spatial index
+  size_t octreeAdds_;
+  size_t octreeRemoves_;
+  size_t octreeCollects_;
+  size_t octreeCollected_;
+
+  IndexQueryStats selfIsectEdge_;
+  IndexQueryStats selfIsectTri_;
+  IndexQueryStats crossSections_;
+
+  // final shape of the index, filled with indexDiagnostics_ only
+  OcTreeDiagnostics octree_;
+
+  size_t smoothIterations_;
+  // vertices relaxed by all iterations
+  size_t smoothMoves_;
+
+  // conjugate gradient iterations of all coordinates and unknown vertices of fairing
+  size_t fairingIterations_;
+  size_t fairingUnknowns_;
+
+  MeshQualityStats quality_;
+
+  // peak heap footprint of triangulation, if allocations are tracked
+  long long peakBytes_;
+
+  // in order of execution
+  std::vector<StageStats> stages_;
+};
+
+void writeStats(std::ostream & os, const TriangulationStats & stats);
+
+// index queries selectivity and tree shape
+void dumpIndexDiagnostics(std::ostream & os, const TriangulationStats & stats);